@@ -0,0 +1,237 @@
+/*-------------------------------------------------------------------------------------------
+ *										BenchKasumi.c
+ *-------------------------------------------------------------------------------------------
+ *
+ * Throughput of the KASUMI implementations used by the attack, on a single core.
+ * Every variant is checked against Kasumi_r() before being timed.
+ *
+ *-------------------------------------------------------------------------------------------*/
+
+#include <stdio.h>         	// printf()
+#include <stdlib.h>			// rand(), malloc()
+#include <string.h>			// memcpy()
+#include <time.h>    	   	// clock()
+#include "Kasumi.h"
+
+#define NBLOCKS (1 << 20)
+#define NKEYS (1 << 20)
+#define NTRIALS 0x10000		// one guess of a 16-bit key word
+
+static u8 K[16] = {
+	0x99, 0x00, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF,
+	0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 
+};
+
+static u64 *blocks, *reference;
+
+static void printRate(char name[], clock_t begin, clock_t end, long n) {
+	printf("%-40s %8.1f ns/op\n", name, (double)(end - begin) / CLOCKS_PER_SEC * 1e9 / n);
+}
+
+static void wrongOutput(char name[]) {
+	printf("%s: WRONG OUTPUT\n", name);
+	exit(1);
+}
+
+static void check(char name[]) {
+	if (memcmp(blocks, reference, NBLOCKS * sizeof(*blocks)))
+		wrongOutput(name);
+}
+
+int main(void) {
+	KasumiKey ks;
+	KasumiFIKey fk;
+	u8 data[8];
+	clock_t begin, end;
+	int maxLanes;
+
+	blocks = malloc(NBLOCKS * sizeof(*blocks));
+	reference = malloc(NBLOCKS * sizeof(*reference));
+
+	for (int i = 0; i < NBLOCKS; i++) {
+		for (int j = 0; j < 8; j++)
+			data[j] = rand();
+		reference[i] = BlockFromBytes(data);
+	}
+
+	KeySchedule_r(&ks, K);
+
+	/*---------------------------------------- FI ---------------------------------------------*/
+
+	u16 *table = malloc(0x10000 * sizeof(u16));
+	u16 subkey = ks.KIi1[0];
+	u16 acc = 0;
+
+	begin = clock();
+	for (int i = 0; i < 64; i++)
+		FITable(table, subkey);
+	end = clock();
+	printRate("FITable() (per entry)", begin, end, 64L * 0x10000);
+
+	begin = clock();
+	for (long i = 0; i < 64L * 0x10000; i++)
+		acc = KasumiFI(acc ^ (u16)i, subkey);
+	end = clock();
+	printRate("FI(), computed", begin, end, 64L * 0x10000);
+
+	begin = clock();
+	for (long i = 0; i < 64L * 0x10000; i++)
+		acc = table[acc ^ (u16)i];
+	end = clock();
+	printRate("FI(), table lookup", begin, end, 64L * 0x10000);
+	printf("(checksum %04x)\n", acc);
+
+	/*--------------------------------------- blocks ------------------------------------------*/
+
+	begin = clock();
+	for (int i = 0; i < NBLOCKS; i++) {
+		BlockToBytes(reference[i], data);
+		Kasumi_r(&ks, data);
+		reference[i] = BlockFromBytes(data);
+	}
+	end = clock();
+	printRate("Kasumi_r() (per block)", begin, end, NBLOCKS);
+
+	for (int i = 0; i < NBLOCKS; i++) {
+		BlockToBytes(reference[i], data);
+		KasumiDecipher_r(&ks, data);
+		blocks[i] = BlockFromBytes(data);
+	}
+
+	begin = clock();
+	KasumiEncryptBlocks(&ks, blocks, NBLOCKS);
+	end = clock();
+	check("KasumiEncryptBlocks()");
+	printRate("KasumiEncryptBlocks()", begin, end, NBLOCKS);
+
+	if (KeyScheduleFI(&fk, K)) {
+		printf("KeyScheduleFI(): out of memory\n");
+		exit(1);
+	}
+	KasumiDecryptBlocksFI(&fk, blocks, NBLOCKS);
+	begin = clock();
+	KasumiEncryptBlocksFI(&fk, blocks, NBLOCKS);
+	end = clock();
+	check("KasumiEncryptBlocksFI()");
+	printRate("KasumiEncryptBlocksFI()", begin, end, NBLOCKS);
+
+	begin = clock();
+	for (int i = 0; i < 16; i++) {
+		FreeKeyScheduleFI(&fk);
+		if (KeyScheduleFI(&fk, K)) {
+			printf("KeyScheduleFI(): out of memory\n");
+			exit(1);
+		}
+	}
+	end = clock();
+	printRate("KeyScheduleFI() (per key)", begin, end, 16);
+	FreeKeyScheduleFI(&fk);
+
+	/*------------------------------------ key schedule ---------------------------------------*/
+
+	// Guess the words K3 and K5 as in phase 4 of the attack
+	KasumiKey guessed;
+	u8 key[16];
+
+	memcpy(key, K, 16);
+	begin = clock();
+	for (long i = 0; i < NKEYS; i++) {
+		key[8] = i >> 8;
+		key[9] = i & 0xff;
+		KeySchedule_r(&guessed, key);
+	}
+	end = clock();
+	printRate("KeySchedule_r() (per key)", begin, end, NKEYS);
+
+	KeySchedule_r(&guessed, K);
+	begin = clock();
+	for (long i = 0; i < NKEYS; i++) {
+		KeyScheduleWord_r(&guessed, 4, i);
+	}
+	end = clock();
+	printRate("KeyScheduleWord_r() (per key)", begin, end, NKEYS);
+
+	KeyScheduleWord_r(&guessed, 2, 0x1234);
+	key[4] = 0x12;
+	key[5] = 0x34;
+	KeySchedule_r(&ks, key);
+	if (memcmp(&guessed, &ks, sizeof(ks)))
+		wrongOutput("KeyScheduleWord_r()");
+	KeySchedule_r(&ks, K);
+
+	maxLanes = KasumiBitsliceLanes();
+
+	for (int lanes = 64; lanes <= maxLanes; lanes *= 2) {
+		char name[64];
+
+		KasumiBitsliceSetLanes(lanes);
+		KasumiDecryptBlocks(&ks, blocks, NBLOCKS);
+
+		begin = clock();
+		KasumiBitsliceEncrypt(K, blocks, NBLOCKS);
+		end = clock();
+		check("KasumiBitsliceEncrypt()");
+		sprintf(name, "KasumiBitsliceEncrypt(), %d lanes", lanes);
+		printRate(name, begin, end, NBLOCKS);
+	}
+
+	/*--------------------------------------- key search --------------------------------------*/
+
+	// Guess K5 for a known (p, c) as in phase 4 of the attack: the right key is the last one
+	u8 (*trialKeys)[16] = malloc(NTRIALS * sizeof(*trialKeys));
+	u16 K5 = (K[8] << 8) + K[9];
+	u64 p = reference[0], c = p;
+	char name[64];
+	int hit = -1;
+
+	KasumiEncryptBlocks(&ks, &c, 1);
+	for (int i = 0; i < NTRIALS; i++) {
+		u16 guess = K5 + 1 + i;
+		memcpy(trialKeys[i], K, 16);
+		trialKeys[i][8] = guess >> 8;
+		trialKeys[i][9] = guess & 0xff;
+	}
+
+	KeySchedule_r(&guessed, K);
+	begin = clock();
+	for (int i = 0; i < NTRIALS && hit < 0; i++) {
+		KeyScheduleWord_r(&guessed, 4, (u16)(K5 + 1 + i));
+		if (KasumiTrialEncrypt(&guessed, p, c))
+			hit = i;
+	}
+	end = clock();
+	if (hit != NTRIALS-1)
+		wrongOutput("KasumiTrialEncrypt()");
+	printRate("KasumiTrialEncrypt() (per key)", begin, end, NTRIALS);
+
+	// blocks[i] under trialKeys[i], one Kasumi_r() per key
+	u64 *expected = malloc(NTRIALS * sizeof(*expected));
+
+	for (int i = 0; i < NTRIALS; i++) {
+		KeySchedule_r(&guessed, trialKeys[i]);
+		BlockToBytes(blocks[i], data);
+		Kasumi_r(&guessed, data);
+		expected[i] = BlockFromBytes(data);
+	}
+
+	begin = clock();
+	KasumiBitsliceEncryptKeys(trialKeys, blocks, NTRIALS);
+	end = clock();
+	if (memcmp(blocks, expected, NTRIALS * sizeof(*blocks)))
+		wrongOutput("KasumiBitsliceEncryptKeys()");
+	free(expected);
+	sprintf(name, "KasumiBitsliceEncryptKeys(), %d lanes", maxLanes);
+	printRate(name, begin, end, NTRIALS);
+
+	begin = clock();
+	hit = KasumiBitsliceSearchKeys(trialKeys, p, c, NTRIALS);
+	end = clock();
+	if (hit != NTRIALS-1)
+		wrongOutput("KasumiBitsliceSearchKeys()");
+	sprintf(name, "KasumiBitsliceSearchKeys(), %d lanes", maxLanes);
+	printRate(name, begin, end, NTRIALS);
+
+	free(trialKeys);
+
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*-------------------------------------------------------------------------------------------
+ *										CandidateSet.c
+ *-------------------------------------------------------------------------------------------
+ *
+ * Sorted vector of packed (KO, KI, KL) triples with in-place intersection (see CandidateSet.h).
+ *
+ *-------------------------------------------------------------------------------------------*/
+
+#include <stdlib.h>			// malloc(), realloc(), qsort()
+#include "CandidateSet.h"
+
+void initCandidateSet(CandidateSet *s) {
+	s -> key = NULL;
+	s -> used = s -> size = 0;
+}
+
+void freeCandidateSet(CandidateSet *s) {
+	free(s -> key);
+	initCandidateSet(s);
+}
+
+void addCandidate(CandidateSet *s, u64 c) {
+	if (s -> used == s -> size) {
+		s -> size = s -> size ? 2 * s -> size : 1024;
+		s -> key = realloc(s -> key, s -> size * sizeof(u64));
+	}
+	s -> key[s -> used++] = c;
+}
+
+static int compareCandidates(const void *a, const void *b) {
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+void sealCandidateSet(CandidateSet *s) {
+	size_t kept = 0;
+
+	qsort(s -> key, s -> used, sizeof(u64), compareCandidates);
+
+	for (size_t i = 0; i < s -> used; i++) {
+		if (kept == 0 || s -> key[i] != s -> key[kept - 1]) {
+			s -> key[kept++] = s -> key[i];
+		}
+	}
+
+	s -> used = kept;
+}
+
+int findCandidate(const CandidateSet *s, u64 c) {
+	size_t lo = 0, hi = s -> used;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (s -> key[mid] < c) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo < s -> used && s -> key[lo] == c;
+}
+
+void intersectCandidateSet(CandidateSet *s, CandidateSet *t) {
+	size_t i = 0, j = 0, kept = 0;
+
+	while (i < s -> used && j < t -> used) {
+		if (s -> key[i] < t -> key[j]) {
+			i++;
+		} else if (s -> key[i] > t -> key[j]) {
+			j++;
+		} else {
+			s -> key[kept++] = s -> key[i];
+			i++;
+			j++;
+		}
+	}
+
+	s -> used = kept;
+	freeCandidateSet(t);
+
+	// give back the memory of the discarded candidates
+	if (kept < s -> size / 4) {
+		s -> size = kept ? kept : 1;
+		s -> key = realloc(s -> key, s -> size * sizeof(u64));
+	}
+}
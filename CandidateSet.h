@@ -0,0 +1,39 @@
+/*---------------------------------------------------------
+ *						CandidateSet.h
+ *---------------------------------------------------------*/
+
+// Set of candidate subkey triples (KO, KI, KL) for the key guessing of the attack.
+// Each triple is packed in a u64 and the set is a sorted vector without duplicates:
+// the candidates of a quartet are appended, then sealed (sorted, duplicates removed),
+// and the sets of successive quartets are intersected in place by a linear merge.
+// The triples come out in (KO, KI, KL) order.
+
+#ifndef __CANDIDATESET_H__
+#define __CANDIDATESET_H__
+
+#include <stddef.h>			// size_t
+#include "Kasumi.h"			// u16, u64
+
+#define CANDIDATE(KO, KI, KL) (((u64)(KO) << 32) | ((u64)(KI) << 16) | (u64)(KL))
+#define CANDIDATE_KO(c) ((u16)((c) >> 32))
+#define CANDIDATE_KI(c) ((u16)((c) >> 16))
+#define CANDIDATE_KL(c) ((u16)(c))
+
+typedef struct {
+	u64 *key;
+	size_t used;
+	size_t size;
+} CandidateSet;
+
+void initCandidateSet(CandidateSet *s);			// empty set, no allocation
+void freeCandidateSet(CandidateSet *s);			// back to the empty set
+void addCandidate(CandidateSet *s, u64 c);		// append: the set must be sealed before the
+												// lookups and the intersections
+void sealCandidateSet(CandidateSet *s);
+
+int findCandidate(const CandidateSet *s, u64 c);
+
+// s = s AND t, in place (both sealed); t is freed
+void intersectCandidateSet(CandidateSet *s, CandidateSet *t);
+
+#endif //__CANDIDATESET_H__
@@ -0,0 +1,180 @@
+/*-------------------------------------------------------------------------------------------
+ *										Checkpoint.c
+ *-------------------------------------------------------------------------------------------
+ *
+ * Tagged binary sections written with fsync() and an atomic rename (see Checkpoint.h).
+ *
+ * File:	magic "KSCP", version (u32), reserved (u64)
+ *			for each section: tag (u32), 0 (u32), bytes (u64), data padded to 8 bytes
+ *			FNV-1a of everything before (u64)
+ *
+ *-------------------------------------------------------------------------------------------*/
+
+#include <stdio.h>			// fopen(), fwrite(), rename(), perror()
+#include <stdlib.h>			// malloc(), realloc()
+#include <string.h>			// memcpy(), strrchr()
+#include <fcntl.h>			// open()
+#include <unistd.h>			// fsync(), close()
+#include "Checkpoint.h"
+
+#define CHECKPOINT_MAGIC CHECKPOINT_TAG('K', 'S', 'C', 'P')
+#define HEADER_BYTES 16
+
+static void reserveCheckpoint(Checkpoint *c, size_t bytes) {
+	if (c -> used + bytes > c -> size) {
+		while (c -> used + bytes > c -> size) c -> size = c -> size ? 2 * c -> size : 1 << 16;
+		c -> data = realloc(c -> data, c -> size);
+	}
+}
+
+static void putCheckpoint(Checkpoint *c, const void *data, size_t bytes) {
+	reserveCheckpoint(c, bytes);
+	memcpy(c -> data + c -> used, data, bytes);
+	c -> used += bytes;
+}
+
+static u64 checksum(const u8 *data, size_t bytes) {
+	u64 h = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < bytes; i++) {
+		h = (h ^ data[i]) * 0x100000001b3ULL;
+	}
+	return h;
+}
+
+void beginCheckpoint(Checkpoint *c) {
+	u32 header[4] = {CHECKPOINT_MAGIC, CHECKPOINT_VERSION, 0, 0};
+
+	c -> data = NULL;
+	c -> used = c -> size = 0;
+	putCheckpoint(c, header, HEADER_BYTES);
+}
+
+void addCheckpointSection(Checkpoint *c, u32 tag, const void *data, size_t bytes) {
+	u32 head[2] = {tag, 0};
+	u64 size = bytes;
+	size_t padding = (8 - bytes % 8) % 8;
+
+	putCheckpoint(c, head, sizeof(head));
+	putCheckpoint(c, &size, sizeof(size));
+	putCheckpoint(c, data, bytes);
+
+	reserveCheckpoint(c, padding);
+	memset(c -> data + c -> used, 0, padding);
+	c -> used += padding;
+}
+
+// The rename is only durable once the directory holding the file is on the disk too
+static int syncDirectory(const char *path) {
+	const char *slash = strrchr(path, '/');
+	char dir[4096] = ".";
+	int fd, err;
+
+	if (slash && (size_t)(slash - path) < sizeof(dir)) {
+		memcpy(dir, path, slash - path + 1);
+		dir[slash - path + 1] = '\0';
+	}
+
+	if ((fd = open(dir, O_RDONLY)) < 0) return -1;
+	err = fsync(fd);
+	close(fd);
+	return err;
+}
+
+int writeCheckpoint(Checkpoint *c, const char *path) {
+	char tmp[4096];
+	u64 sum = checksum(c -> data, c -> used);
+	FILE *f;
+	int err = -1;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	if ((f = fopen(tmp, "wb")) == NULL) {
+		perror(tmp);
+		freeCheckpoint(c);
+		return -1;
+	}
+
+	if (fwrite(c -> data, 1, c -> used, f) == c -> used && fwrite(&sum, sizeof(sum), 1, f) == 1 &&
+		fflush(f) == 0 && fsync(fileno(f)) == 0) {
+		err = 0;
+	}
+	if (fclose(f) != 0) err = -1;
+
+	if (err || rename(tmp, path) != 0 || syncDirectory(path) != 0) {
+		perror(path);
+		remove(tmp);
+		err = -1;
+	}
+
+	freeCheckpoint(c);
+	return err;
+}
+
+int readCheckpoint(Checkpoint *c, const char *path) {
+	FILE *f = fopen(path, "rb");
+	long bytes;
+	u64 sum;
+
+	c -> data = NULL;
+	c -> used = c -> size = 0;
+
+	if (f == NULL) return -1;
+
+	if (fseek(f, 0, SEEK_END) != 0 || (bytes = ftell(f)) < HEADER_BYTES + (long)sizeof(sum) ||
+		fseek(f, 0, SEEK_SET) != 0) {
+		fclose(f);
+		fprintf(stderr, "%s: not a checkpoint\n", path);
+		return -1;
+	}
+
+	reserveCheckpoint(c, bytes);
+	if (fread(c -> data, 1, bytes, f) != (size_t)bytes) {
+		fclose(f);
+		freeCheckpoint(c);
+		fprintf(stderr, "%s: read error\n", path);
+		return -1;
+	}
+	fclose(f);
+
+	c -> used = bytes - sizeof(sum);
+	memcpy(&sum, c -> data + c -> used, sizeof(sum));
+
+	u32 *header = (u32 *)c -> data;
+
+	if (header[0] != CHECKPOINT_MAGIC || header[1] != CHECKPOINT_VERSION || sum != checksum(c -> data, c -> used)) {
+		freeCheckpoint(c);
+		fprintf(stderr, "%s: corrupted checkpoint or version other than %d\n", path, CHECKPOINT_VERSION);
+		return -1;
+	}
+
+	return 0;
+}
+
+const void *findCheckpointSection(const Checkpoint *c, u32 tag, size_t *bytes) {
+	size_t pos = HEADER_BYTES;
+
+	while (pos + 16 <= c -> used) {
+		u32 t;
+		u64 size;
+
+		memcpy(&t, c -> data + pos, sizeof(t));
+		memcpy(&size, c -> data + pos + 8, sizeof(size));
+		pos += 16;
+
+		if (size > c -> used - pos) break;
+		if (t == tag) {
+			*bytes = size;
+			return c -> data + pos;
+		}
+		pos += size + (8 - size % 8) % 8;
+	}
+
+	return NULL;
+}
+
+void freeCheckpoint(Checkpoint *c) {
+	free(c -> data);
+	c -> data = NULL;
+	c -> used = c -> size = 0;
+}
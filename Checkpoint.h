@@ -0,0 +1,50 @@
+/*---------------------------------------------------------
+ *						Checkpoint.h
+ *---------------------------------------------------------*/
+
+// Binary checkpoint files of the attack, so that a long run stopped in phase 3 or 4 can be
+// resumed. A checkpoint is a list of tagged sections (raw arrays, tags of four characters)
+// closed by a checksum. It is written to <path>.tmp, flushed to the disk with fsync() and
+// renamed over <path>: a crash while writing leaves the previous checkpoint untouched.
+//
+//		Checkpoint c;
+//		beginCheckpoint(&c);
+//		addCheckpointSection(&c, CHECKPOINT_TAG('Q','R','T','S'), table, n * sizeof(*table));
+//		writeCheckpoint(&c, path);		// also frees the sections
+//
+//		if (readCheckpoint(&c, path) == 0) {
+//			table = findCheckpointSection(&c, CHECKPOINT_TAG('Q','R','T','S'), &bytes);
+//			...
+//			freeCheckpoint(&c);
+//		}
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <stddef.h>			// size_t
+#include "Kasumi.h"			// u8, u32, u64
+
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_TAG(a, b, c, d) (((u32)(a) << 24) | ((u32)(b) << 16) | ((u32)(c) << 8) | (u32)(d))
+
+typedef struct {
+	u8 *data;				// header and sections, as in the file
+	size_t used;
+	size_t size;
+} Checkpoint;
+
+void beginCheckpoint(Checkpoint *c);
+void addCheckpointSection(Checkpoint *c, u32 tag, const void *data, size_t bytes);
+
+// 0 on success, -1 (with the reason on stderr) otherwise: the checkpoint is freed in any case
+int writeCheckpoint(Checkpoint *c, const char *path);
+
+// 0 on success, -1 if the file is missing, truncated, corrupted or of another version
+int readCheckpoint(Checkpoint *c, const char *path);
+
+// The section with the given tag (its size in *bytes), or NULL. Aligned to 8 bytes.
+const void *findCheckpointSection(const Checkpoint *c, u32 tag, size_t *bytes);
+
+void freeCheckpoint(Checkpoint *c);
+
+#endif //__CHECKPOINT_H__
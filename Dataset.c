@@ -0,0 +1,138 @@
+/*-------------------------------------------------------------------------------------------
+ *										Dataset.c
+ *-------------------------------------------------------------------------------------------
+ *
+ * Versioned files of fixed-size records, written with pwrite() and read through mmap()
+ * (see Dataset.h).
+ *
+ *-------------------------------------------------------------------------------------------*/
+
+#include <stdio.h>			// fprintf(), perror(), rename()
+#include <string.h>			// memset(), strlen()
+#include <errno.h>			// errno, ENOENT
+#include <fcntl.h>			// open()
+#include <unistd.h>			// pwrite(), fsync(), close()
+#include <sys/mman.h>		// mmap(), munmap(), madvise()
+#include <sys/stat.h>		// fstat()
+#include "Dataset.h"
+
+#define DATASET_MAGIC 0x5344534b		// "KSDS" as read from the file
+
+_Static_assert(sizeof(DatasetHeader) == 64, "the header is 64 bytes");
+
+int createDataset(DatasetWriter *w, const char *path, u32 kind, u32 recordBytes, u64 seed, u64 key) {
+	char tmp[4096 + 4];
+
+	if (strlen(path) >= sizeof(w -> path)) {
+		fprintf(stderr, "%s: path too long\n", path);
+		return -1;
+	}
+	snprintf(w -> path, sizeof(w -> path), "%s", path);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	memset(&(w -> header), 0, sizeof(w -> header));
+	w -> header.magic = DATASET_MAGIC;
+	w -> header.version = DATASET_VERSION;
+	w -> header.kind = kind;
+	w -> header.recordBytes = recordBytes;
+	w -> header.seed = seed;
+	w -> header.key = key;
+
+	if ((w -> fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		perror(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+int writeDatasetRecords(DatasetWriter *w, u64 first, const void *records, u64 count) {
+	const u8 *p = records;
+	size_t bytes = count * w -> header.recordBytes;
+	off_t offset = sizeof(DatasetHeader) + first * w -> header.recordBytes;
+
+	while (bytes > 0) {
+		ssize_t n = pwrite(w -> fd, p, bytes, offset);
+
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			perror(w -> path);
+			return -1;
+		}
+		p += n;
+		bytes -= n;
+		offset += n;
+	}
+	return 0;
+}
+
+// The header goes last: a file cut short is never taken for a complete dataset
+int closeDatasetWriter(DatasetWriter *w, u64 count) {
+	char tmp[4096 + 4];
+	int err = 0;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", w -> path);
+	w -> header.count = count;
+
+	if (pwrite(w -> fd, &(w -> header), sizeof(DatasetHeader), 0) != sizeof(DatasetHeader) || fsync(w -> fd) != 0) {
+		err = -1;
+	}
+	if (close(w -> fd) != 0) err = -1;
+
+	if (err || rename(tmp, w -> path) != 0) {
+		perror(w -> path);
+		remove(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+int openDataset(Dataset *d, const char *path, u32 kind, u32 recordBytes) {
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	d -> map = NULL;
+	d -> mapBytes = 0;
+
+	if (fd < 0) {
+		if (errno != ENOENT) perror(path);
+		return -1;
+	}
+
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(DatasetHeader)) {
+		fprintf(stderr, "%s: not a dataset\n", path);
+		close(fd);
+		return -1;
+	}
+
+	d -> mapBytes = st.st_size;
+	d -> map = mmap(NULL, d -> mapBytes, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (d -> map == MAP_FAILED) {
+		perror(path);
+		d -> map = NULL;
+		return -1;
+	}
+
+	d -> header = d -> map;
+	d -> records = (const u8 *)d -> map + sizeof(DatasetHeader);
+
+	const DatasetHeader *h = d -> header;
+
+	if (h -> magic != DATASET_MAGIC || h -> version != DATASET_VERSION || h -> kind != kind ||
+		h -> recordBytes != recordBytes || h -> count > (d -> mapBytes - sizeof(DatasetHeader)) / recordBytes) {
+		fprintf(stderr, "%s: not a version %d dataset of this kind\n", path, DATASET_VERSION);
+		closeDataset(d);
+		return -1;
+	}
+
+	// The records are read once, front to back
+	madvise(d -> map, d -> mapBytes, MADV_SEQUENTIAL);
+	return 0;
+}
+
+void closeDataset(Dataset *d) {
+	if (d -> map) munmap(d -> map, d -> mapBytes);
+	d -> map = NULL;
+	d -> mapBytes = 0;
+}
@@ -0,0 +1,66 @@
+/*---------------------------------------------------------
+ *						Dataset.h
+ *---------------------------------------------------------*/
+
+// Binary files of the data collected by the attack, so that a run can start from the data of
+// an earlier one instead of asking the oracle again: the raw structures (each ciphertext with
+// the other ciphertext of its pair) or the candidate quartets (C_a, C_b, C_c, C_d) after the
+// join. A file is a 64-byte header followed by fixed-size records; the reader maps it with
+// mmap() and hands out the records in place, without copying them.
+//
+//		DatasetWriter w;
+//		createDataset(&w, path, DATASET_QUARTETS, sizeof(*r), seed, key);
+//		writeDatasetRecords(&w, i, r, 1);		// any thread, any order
+//		closeDatasetWriter(&w, n);
+//
+//		Dataset d;
+//		if (openDataset(&d, path, DATASET_QUARTETS, sizeof(*r)) == 0) {
+//			r = d.records;						// d.header -> count records
+//			closeDataset(&d);
+//		}
+
+#ifndef __DATASET_H__
+#define __DATASET_H__
+
+#include <stddef.h>			// size_t
+#include "Kasumi.h"			// u8, u32, u64
+
+#define DATASET_VERSION 1
+
+#define DATASET_STRUCTURES 1	// (C, P) for every ciphertext of structure (a), then of (b)
+#define DATASET_QUARTETS 2		// candidate quartets, in the order they were collected
+
+typedef struct {
+	u32 magic;				// "KSDS"
+	u32 version;
+	u32 kind;				// DATASET_STRUCTURES or DATASET_QUARTETS
+	u32 recordBytes;
+	u64 count;				// records
+	u64 seed;				// seed of the run that collected the data
+	u64 key;				// fingerprint of the key used by the oracle
+	u8 reserved[24];
+} DatasetHeader;
+
+typedef struct {
+	const DatasetHeader *header;
+	const void *records;	// in the mapping, 64-byte aligned
+	void *map;
+	size_t mapBytes;
+} Dataset;
+
+typedef struct {
+	int fd;
+	char path[4096];		// written to <path>.tmp, renamed when closed
+	DatasetHeader header;
+} DatasetWriter;
+
+// 0 on success, -1 (with the reason on stderr) otherwise
+int createDataset(DatasetWriter *w, const char *path, u32 kind, u32 recordBytes, u64 seed, u64 key);
+int writeDatasetRecords(DatasetWriter *w, u64 first, const void *records, u64 count);
+int closeDatasetWriter(DatasetWriter *w, u64 count);
+
+// 0 on success, -1 if the file is missing or not a dataset of that kind and record size
+int openDataset(Dataset *d, const char *path, u32 kind, u32 recordBytes);
+void closeDataset(Dataset *d);
+
+#endif //__DATASET_H__
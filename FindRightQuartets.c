@@ -51,6 +51,7 @@ char compareArray(u8 a[], u8 b[], int size)	{
 
 static u8 *Ka;
 static u8 Kb[16], Kc[16], Kd[16];
+static KasumiKey ksA, ksB, ksC, ksD;		// expanded once, reused by every oracle query
 
 /*-------------------------------------------------------------------------------------------
  * Let ΔK_ab = (0, 0, 8000_x , 0, 0, 0, 0, 0) and ΔK_ac = (0, 0, 0, 0, 0, 0, 8000_x , 0), and
@@ -247,6 +248,11 @@ int main(void) {
 
 	generateRelatedKeys(Ka);
 
+	KeySchedule_r(&ksA, Ka);
+	KeySchedule_r(&ksB, Kb);
+	KeySchedule_r(&ksC, Kc);
+	KeySchedule_r(&ksD, Kd);
+
 	//printHex("Ka", Ka, 16);
 	//printHex("Kb", Kb, 16);
 	//printHex("Kc", Kc, 16);
@@ -294,8 +300,7 @@ int main(void) {
 			 *-------------------------------------------------------------------------------------------*/
 
 			memcpy(Pa, &Ca[0], 8*sizeof(*Ca));
-			KeySchedule(Ka);
-			KasumiDecipher(Pa);
+			KasumiDecipher_r(&ksA, Pa);
 
 			//printHex("Pa", Pa, 8);
 
@@ -314,8 +319,7 @@ int main(void) {
 			//printHex("Pb", Pb, 8);
 
 			memcpy(Cb, &Pb[0], 8*sizeof(*Pb));
-			KeySchedule(Kb);
-			Kasumi(Cb);
+			Kasumi_r(&ksB, Cb);
 
 			//printHex("Cb", Cb, 8);
 
@@ -370,8 +374,7 @@ int main(void) {
 			 *-------------------------------------------------------------------------------------------*/
 
 			memcpy(Pc, &Cc[0], 8*sizeof(*Cc));
-			KeySchedule(Kc);
-			KasumiDecipher(Pc);
+			KasumiDecipher_r(&ksC, Pc);
 
 			//printHex("Pc", Pc, 8);
 
@@ -390,8 +393,7 @@ int main(void) {
 			//printHex("Pd", Pd, 8);
 
 			memcpy(Cd, &Pd[0], 8*sizeof(*Pd));
-			KeySchedule(Kd);
-			Kasumi(Cd);
+			Kasumi_r(&ksD, Cd);
 
 			//printHex("Cd", Cd, 8);
 
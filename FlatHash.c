@@ -0,0 +1,82 @@
+/*-------------------------------------------------------------------------------------------
+ *										FlatHash.c
+ *-------------------------------------------------------------------------------------------
+ *
+ * Open-addressing multimap with 32-bit keys and inline 16-byte values (see FlatHash.h).
+ *
+ *-------------------------------------------------------------------------------------------*/
+
+#include <stdlib.h>			// malloc()
+#include <string.h>			// memcpy(), memset()
+#include "FlatHash.h"
+
+// The slots are at most 2/3 full, so the probe sequences stay short
+#define SLOTS(n) ((n) + (n) / 2 + 1)
+
+// Home slot of a key: the keys (halves of ciphertexts) are already uniform, the mixing
+// only protects from structured ones; the product maps the hash onto 0 .. size-1
+static inline size_t home(const FlatHash *t, u32 key) {
+	key ^= key >> 16;
+	key *= 0x7feb352d;
+	key ^= key >> 15;
+	key *= 0x846ca68b;
+	key ^= key >> 16;
+	return (size_t)(((u64)key * t -> size) >> 32);
+}
+
+void initFlatHash(FlatHash *t, size_t n) {
+	size_t size = SLOTS(n);
+	size_t words = (size + 63) / 64;
+	u8 *slab = malloc(size * (sizeof(u32) + FLAT_HASH_VALUE) + words * sizeof(u64));
+
+	t -> size = size;
+	t -> used = 0;
+	t -> full = (u64 *)slab;
+	t -> keys = (u32 *)(slab + words * sizeof(u64));
+	t -> values = (u8 (*)[FLAT_HASH_VALUE])(slab + words * sizeof(u64) + size * sizeof(u32));
+	memset(t -> full, 0, words * sizeof(u64));
+}
+
+void freeFlatHash(FlatHash *t) {
+	free(t -> full);		// start of the slab
+	t -> full = NULL;
+	t -> keys = NULL;
+	t -> values = NULL;
+	t -> size = t -> used = 0;
+}
+
+void addFlatHash(FlatHash *t, u32 key, const u8 *value) {
+	size_t s = home(t, key);
+
+	while ((t -> full[s / 64] >> (s % 64)) & 1) {
+		if (++s == t -> size)
+			s = 0;
+	}
+
+	t -> full[s / 64] |= 1ULL << (s % 64);
+	t -> keys[s] = key;
+	memcpy(t -> values[s], value, FLAT_HASH_VALUE);
+	t -> used++;
+}
+
+u8 *findFlatHash(const FlatHash *t, u32 key, size_t *cursor) {
+	// *cursor counts the slots already probed after the home slot
+	size_t s = home(t, key) + *cursor;
+
+	if (s >= t -> size)
+		s -= t -> size;
+
+	while ((t -> full[s / 64] >> (s % 64)) & 1) {
+		(*cursor)++;
+		if (t -> keys[s] == key)
+			return t -> values[s];
+		if (++s == t -> size)
+			s = 0;
+	}
+
+	return NULL;
+}
+
+size_t flatHashBytes(const FlatHash *t) {
+	return t -> size * (sizeof(u32) + FLAT_HASH_VALUE) + (t -> size + 63) / 64 * sizeof(u64);
+}
@@ -0,0 +1,39 @@
+/*---------------------------------------------------------
+ *						FlatHash.h
+ *---------------------------------------------------------*/
+
+// Multimap from 32-bit keys to 16-byte values for the data collection of the attack.
+// The number of entries is known in advance, so the whole table is a single allocation:
+// open addressing with linear probing, the keys in one array and the values in another,
+// no per-entry malloc() and no hash handle. A key can be stored many times and
+// findFlatHash() returns every value stored under it, in insertion order.
+
+#ifndef __FLATHASH_H__
+#define __FLATHASH_H__
+
+#include <stddef.h>			// size_t
+#include "Kasumi.h"			// u8, u32, u64
+
+#define FLAT_HASH_VALUE 16	// bytes of a value
+
+typedef struct {
+	size_t size;			// slots
+	size_t used;			// entries stored
+	u32 *keys;
+	u8 (*values)[FLAT_HASH_VALUE];
+	u64 *full;				// bit s set: slot s holds an entry
+} FlatHash;
+
+void initFlatHash(FlatHash *t, size_t n);		// room for n entries
+void freeFlatHash(FlatHash *t);
+void addFlatHash(FlatHash *t, u32 key, const u8 *value);
+
+// Next value stored under key, or NULL when there are no more. *cursor must be 0 at
+// the first call and is advanced by each call:
+//		size_t cursor = 0;
+//		while ((value = findFlatHash(t, key, &cursor)) != NULL) ...
+u8 *findFlatHash(const FlatHash *t, u32 key, size_t *cursor);
+
+size_t flatHashBytes(const FlatHash *t);		// memory taken by the table
+
+#endif //__FLATHASH_H__
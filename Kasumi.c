@@ -14,6 +14,7 @@
  *
  *-----------------------------------------------------------------------*/
 
+#include <stdlib.h>
 #include "Kasumi.h"
 
 /*--------- 16 bit rotate left ------------------------------------------*/
@@ -51,9 +52,10 @@ typedef union {
 // Generiamo poi un secondo array di chiavi K1', ..., K8' xorando le chiavi Kj per una costante.
 // Le chiavi di round delle varie funzioni vengono generate a partire da queste chiavi, quindi le possiamo vedere come array di 8 valoru a 16 bit.
 
-static u16 KLi1[8], KLi2[8];
-static u16 KOi1[8], KOi2[8], KOi3[8];
-static u16 KIi1[8], KIi2[8], KIi3[8];
+// KeySchedule(), Kasumi() and KasumiDecipher() share this single static key;
+// the _r variants take a caller-owned KasumiKey instead.
+
+static KasumiKey K;
 
 /*---------------------------------------------------------------------
  * FI()
@@ -63,7 +65,7 @@ static u16 KIi1[8], KIi2[8], KIi3[8];
 
 // FI prende 16 bit di dati di input in e 16 bit di subkey
 
-static u16 FI( u16 in, u16 subkey )
+static inline u16 FI( u16 in, u16 subkey )
 {
 	u16 nine, seven;	// sono le due metà diseguali in cui suddividiamo l'input
 
@@ -155,12 +157,12 @@ static u16 FI( u16 in, u16 subkey )
  * FO()
  * The FO() function.
  * Transforms a 32-bit value. Uses <index> to identify the
- * appropriate subkeys to use.
+ * appropriate subkeys of <ks> to use.
  *---------------------------------------------------------------------*/
 
 // prende 32 bit di dati in input e 2 set di sottochiavi: 48 bit KOi e 48 bit KIi (se abbiamo noto il key schedule separatamente, ci basta avere i)
 
-static u32 FO( u32 in, int index )
+static inline u32 FO( const KasumiKey *ks, u32 in, int index )
 {
 	u16 left, right;
 
@@ -174,16 +176,16 @@ static u32 FO( u32 in, int index )
 	// Rj = FI(Lj-1 xor KOij, KIij) xor Rj-1
 	// Lj = Rj-1
 
-	left ^= KOi1[index];
-	left = FI( left, KIi1[index] );		// le chiavi sono variabili globaili dichiarate all'inizio, ma quando vengono inizializzate?
+	left ^= ks->KOi1[index];
+	left = FI( left, ks->KIi1[index] );
 	left ^= right;
 
-	right ^= KOi2[index];
-	right = FI( right, KIi2[index] );
+	right ^= ks->KOi2[index];
+	right = FI( right, ks->KIi2[index] );
 	right ^= left;
 
-	left ^= KOi3[index];
-	left = FI( left, KIi3[index] );
+	left ^= ks->KOi3[index];
+	left = FI( left, ks->KIi3[index] );
 	left ^= right;
 
 	// ritorniamo il valore a 32 bit L3||R3
@@ -197,12 +199,12 @@ static u32 FO( u32 in, int index )
  * FL()
  * The FL() function.
  * Transforms a 32-bit value. Uses <index> to identify the
- * appropriate subkeys to use.
+ * appropriate subkeys of <ks> to use.
  *---------------------------------------------------------------------*/
 
 // prende in input 32 bit di dati e 32 bit di sottochiave (qui la identifico con l'indice)
 
-static u32 FL( u32 in, int index )
+static inline u32 FL( const KasumiKey *ks, u32 in, int index )
 {
 	u16 l, r, a, b;
 
@@ -215,12 +217,12 @@ static u32 FL( u32 in, int index )
 
 	// R' = R xor ROL(L and KLi1)
 
-	a = (u16) (l & KLi1[index]);
+	a = (u16) (l & ks->KLi1[index]);
 	r ^= ROL16(a,1);
 
 	// L' = L xor ROL(R' or KL12)
 
-	b = (u16)(r | KLi2[index]);
+	b = (u16)(r | ks->KLi2[index]);
 	l ^= ROL16(b,1);
 	
 	/* put the two halves back together */
@@ -233,12 +235,12 @@ static u32 FL( u32 in, int index )
 }
 
 /*---------------------------------------------------------------------
- * Kasumi()
+ * Kasumi_r()
  * the Main algorithm (fig 1). Apply the same pair of operations
  * four times. Transforms the 64-bit input.
  *---------------------------------------------------------------------*/
 
-void Kasumi( u8 *data )		// puntatore a char (8 bit), ovvero al primo carattere dell'input (metterò l'input in un array di 64 char)
+void Kasumi_r( const KasumiKey *ks, u8 *data )		// puntatore a char (8 bit), ovvero al primo carattere dell'input (metterò l'input in un array di 64 char)
 {
 	u32 left, right, temp;
 	DWORD *d;				// puntatore a double word (32 bit)
@@ -256,14 +258,14 @@ void Kasumi( u8 *data )		// puntatore a char (8 bit), ovvero al primo carattere
 
 		// fi(i, RKi) = FO(FL(I, KLi), KOi, KIi)	se i dispari
 
-		temp = FL( left, n);
-		temp = FO( temp, n++ );
+		temp = FL( ks, left, n);
+		temp = FO( ks, temp, n++ );
 		right ^= temp;
 
 		// fi(i, RKi) = FL(FO(I, KOi, KIi), KLi)	se i pari
 
-		temp = FO( right, n);
-		temp = FL( temp, n++ );
+		temp = FO( ks, right, n);
+		temp = FL( ks, temp, n++ );
 		left ^= temp;
 	}while( n<=7 );
 
@@ -278,11 +280,11 @@ void Kasumi( u8 *data )		// puntatore a char (8 bit), ovvero al primo carattere
 }
 
 /*---------------------------------------------------------------------
- * KasumiDecipher()
+ * KasumiDecipher_r()
  * Apply Kasumi functions in reverse
  *---------------------------------------------------------------------*/
 
-void KasumiDecipher( u8 *data )
+void KasumiDecipher_r( const KasumiKey *ks, u8 *data )
 {
 	u32 left, right, temp;
 	DWORD *d;
@@ -300,14 +302,14 @@ void KasumiDecipher( u8 *data )
 
 		// fi(i, RKi) = FL(FO(I, KOi, KIi), KLi)	se i pari
 
-		temp = FO( right, n);
-		temp = FL( temp, n-- );
+		temp = FO( ks, right, n);
+		temp = FL( ks, temp, n-- );
 		left ^= temp;
 
 		// fi(i, RKi) = FO(FL(I, KLi), KOi, KIi)	se i dispari
 
-		temp = FL( left, n);
-		temp = FO( temp, n-- );
+		temp = FL( ks, left, n);
+		temp = FO( ks, temp, n-- );
 		right ^= temp;
 	}while( n>=0 );
 
@@ -320,16 +322,331 @@ void KasumiDecipher( u8 *data )
 }
 
 /*---------------------------------------------------------------------
- * KeySchedule()
- * Build the key schedule. Most "key" operations use 16-bit
+ * KasumiEncryptBlocks(), KasumiDecryptBlocks()
+ * Transform <n> 64-bit blocks in place. Each block is held as a
+ * native u64 whose most significant byte is the first byte of the
+ * block, so no per-block endian shuffling is needed.
+ * Blocks are processed KASUMI_LANES at a time: the rounds of the
+ * different lanes are independent and the CPU can overlap their
+ * FO()/FL() dependency chains.
+ *---------------------------------------------------------------------*/
+
+#define KASUMI_LANES 4
+
+#define ODD_ROUND(l,r,n)	r ^= FO( ks, FL( ks, l, n ), n )
+#define EVEN_ROUND(l,r,n)	l ^= FL( ks, FO( ks, r, n ), n )
+
+void KasumiEncryptBlocks( const KasumiKey *ks, u64 *blocks, int n )
+{
+	u32 l0, l1, l2, l3, r0, r1, r2, r3;
+	int i, k;
+
+	for( i=0; i+KASUMI_LANES<=n; i+=KASUMI_LANES )
+	{
+		l0 = (u32)(blocks[i]>>32);		r0 = (u32)blocks[i];
+		l1 = (u32)(blocks[i+1]>>32);	r1 = (u32)blocks[i+1];
+		l2 = (u32)(blocks[i+2]>>32);	r2 = (u32)blocks[i+2];
+		l3 = (u32)(blocks[i+3]>>32);	r3 = (u32)blocks[i+3];
+
+		for( k=0; k<8; k+=2 )
+		{
+			ODD_ROUND(l0,r0,k);		ODD_ROUND(l1,r1,k);
+			ODD_ROUND(l2,r2,k);		ODD_ROUND(l3,r3,k);
+			EVEN_ROUND(l0,r0,k+1);	EVEN_ROUND(l1,r1,k+1);
+			EVEN_ROUND(l2,r2,k+1);	EVEN_ROUND(l3,r3,k+1);
+		}
+
+		blocks[i] = (((u64)l0)<<32) | r0;
+		blocks[i+1] = (((u64)l1)<<32) | r1;
+		blocks[i+2] = (((u64)l2)<<32) | r2;
+		blocks[i+3] = (((u64)l3)<<32) | r3;
+	}
+
+	/* Tail: the remaining (n mod KASUMI_LANES) blocks one at a time */
+
+	for( ; i<n; ++i )
+	{
+		l0 = (u32)(blocks[i]>>32);		r0 = (u32)blocks[i];
+		for( k=0; k<8; k+=2 )
+		{
+			ODD_ROUND(l0,r0,k);
+			EVEN_ROUND(l0,r0,k+1);
+		}
+		blocks[i] = (((u64)l0)<<32) | r0;
+	}
+}
+
+void KasumiDecryptBlocks( const KasumiKey *ks, u64 *blocks, int n )
+{
+	u32 l0, l1, l2, l3, r0, r1, r2, r3;
+	int i, k;
+
+	for( i=0; i+KASUMI_LANES<=n; i+=KASUMI_LANES )
+	{
+		l0 = (u32)(blocks[i]>>32);		r0 = (u32)blocks[i];
+		l1 = (u32)(blocks[i+1]>>32);	r1 = (u32)blocks[i+1];
+		l2 = (u32)(blocks[i+2]>>32);	r2 = (u32)blocks[i+2];
+		l3 = (u32)(blocks[i+3]>>32);	r3 = (u32)blocks[i+3];
+
+		for( k=7; k>0; k-=2 )
+		{
+			EVEN_ROUND(l0,r0,k);	EVEN_ROUND(l1,r1,k);
+			EVEN_ROUND(l2,r2,k);	EVEN_ROUND(l3,r3,k);
+			ODD_ROUND(l0,r0,k-1);	ODD_ROUND(l1,r1,k-1);
+			ODD_ROUND(l2,r2,k-1);	ODD_ROUND(l3,r3,k-1);
+		}
+
+		blocks[i] = (((u64)l0)<<32) | r0;
+		blocks[i+1] = (((u64)l1)<<32) | r1;
+		blocks[i+2] = (((u64)l2)<<32) | r2;
+		blocks[i+3] = (((u64)l3)<<32) | r3;
+	}
+
+	for( ; i<n; ++i )
+	{
+		l0 = (u32)(blocks[i]>>32);		r0 = (u32)blocks[i];
+		for( k=7; k>0; k-=2 )
+		{
+			EVEN_ROUND(l0,r0,k);
+			ODD_ROUND(l0,r0,k-1);
+		}
+		blocks[i] = (((u64)l0)<<32) | r0;
+	}
+}
+
+/*---------------------------------------------------------------------
+ * KasumiTrialEncrypt()
+ * Return 1 if <ks> encrypts the block <p> into <c>. Round 8 (even)
+ * leaves the right half alone, so the right half of <c> is already
+ * the right half after round 7: a wrong key is rejected there, and
+ * round 8 only runs, on the left half, when those 32 bits agree.
+ *---------------------------------------------------------------------*/
+
+int KasumiTrialEncrypt( const KasumiKey *ks, u64 p, u64 c )
+{
+	u32 l, r;
+	int k;
+
+	l = (u32)(p>>32);	r = (u32)p;
+
+	for( k=0; k<6; k+=2 )
+	{
+		ODD_ROUND(l,r,k);
+		EVEN_ROUND(l,r,k+1);
+	}
+	ODD_ROUND(l,r,6);
+
+	if( r != (u32)c )
+		return( 0 );
+
+	EVEN_ROUND(l,r,7);
+
+	return( l == (u32)(c>>32) );
+}
+
+/*---------------------------------------------------------------------
+ * KasumiFI(), FITable()
+ * FI() with a fixed subkey is a permutation of the 16-bit values:
+ * FITable() tabulates it, so that FI(x, subkey) = table[x] costs a
+ * single lookup instead of four S-box lookups.
+ *---------------------------------------------------------------------*/
+
+u16 KasumiFI( u16 in, u16 subkey )
+{
+	return( FI( in, subkey ) );
+}
+
+void FITable( u16 *table, u16 subkey )
+{
+	int x;
+
+	for( x=0; x<=0xFFFF; ++x )
+		table[x] = FI( (u16)x, subkey );
+}
+
+/*---------------------------------------------------------------------
+ * KeyScheduleFI(), FreeKeyScheduleFI()
+ * Expand <key> and tabulate its FI() functions. Every KIij subkey is
+ * one of the eight K'j words, so eight tables (1 MB) serve all the
+ * 24 FI() of the cipher. Returns -1, with no tables, when the memory
+ * cannot be allocated, 0 otherwise.
+ *---------------------------------------------------------------------*/
+
+int KeyScheduleFI( KasumiFIKey *fk, u8 *key )
+{
+	u16 *tables;
+	int n;
+
+	KeySchedule_r( &fk->ks, key );
+
+	/* KIi1[n] = K'[n+4], so table j holds FI( . , K'[j] ) = FI( . , KIi1[j-4] ) */
+
+	tables = fk->tables = malloc( 8*0x10000*sizeof(u16) );
+	if( tables == NULL )
+		return( -1 );
+
+	for( n=0; n<8; ++n )
+		FITable( tables + 0x10000*((n+4)&0x7), fk->ks.KIi1[n] );
+
+	for( n=0; n<8; ++n )
+	{
+		fk->FIi1[n] = tables + 0x10000*((n+4)&0x7);
+		fk->FIi2[n] = tables + 0x10000*((n+3)&0x7);
+		fk->FIi3[n] = tables + 0x10000*((n+7)&0x7);
+	}
+
+	return( 0 );
+}
+
+void FreeKeyScheduleFI( KasumiFIKey *fk )
+{
+	free( fk->tables );
+	fk->tables = NULL;
+}
+
+/*---------------------------------------------------------------------
+ * FOT()
+ * FO() with each FI() replaced by a lookup in the tables of <fk>.
+ *---------------------------------------------------------------------*/
+
+static inline u32 FOT( const KasumiFIKey *fk, u32 in, int index )
+{
+	u16 left, right;
+
+	left = (u16)(in>>16);
+	right = (u16) in;
+
+	left = fk->FIi1[index][left ^ fk->ks.KOi1[index]] ^ right;
+	right = fk->FIi2[index][right ^ fk->ks.KOi2[index]] ^ left;
+	left = fk->FIi3[index][left ^ fk->ks.KOi3[index]] ^ right;
+
+	return( (((u32)right)<<16)+left );
+}
+
+/*---------------------------------------------------------------------
+ * KasumiEncryptBlocksFI(), KasumiDecryptBlocksFI()
+ * KasumiEncryptBlocks()/KasumiDecryptBlocks() using FOT().
+ *---------------------------------------------------------------------*/
+
+#define ODD_ROUND_FI(l,r,n)		r ^= FOT( fk, FL( &fk->ks, l, n ), n )
+#define EVEN_ROUND_FI(l,r,n)	l ^= FL( &fk->ks, FOT( fk, r, n ), n )
+
+void KasumiEncryptBlocksFI( const KasumiFIKey *fk, u64 *blocks, int n )
+{
+	u32 l0, l1, l2, l3, r0, r1, r2, r3;
+	int i, k;
+
+	for( i=0; i+KASUMI_LANES<=n; i+=KASUMI_LANES )
+	{
+		l0 = (u32)(blocks[i]>>32);		r0 = (u32)blocks[i];
+		l1 = (u32)(blocks[i+1]>>32);	r1 = (u32)blocks[i+1];
+		l2 = (u32)(blocks[i+2]>>32);	r2 = (u32)blocks[i+2];
+		l3 = (u32)(blocks[i+3]>>32);	r3 = (u32)blocks[i+3];
+
+		for( k=0; k<8; k+=2 )
+		{
+			ODD_ROUND_FI(l0,r0,k);		ODD_ROUND_FI(l1,r1,k);
+			ODD_ROUND_FI(l2,r2,k);		ODD_ROUND_FI(l3,r3,k);
+			EVEN_ROUND_FI(l0,r0,k+1);	EVEN_ROUND_FI(l1,r1,k+1);
+			EVEN_ROUND_FI(l2,r2,k+1);	EVEN_ROUND_FI(l3,r3,k+1);
+		}
+
+		blocks[i] = (((u64)l0)<<32) | r0;
+		blocks[i+1] = (((u64)l1)<<32) | r1;
+		blocks[i+2] = (((u64)l2)<<32) | r2;
+		blocks[i+3] = (((u64)l3)<<32) | r3;
+	}
+
+	for( ; i<n; ++i )
+	{
+		l0 = (u32)(blocks[i]>>32);		r0 = (u32)blocks[i];
+		for( k=0; k<8; k+=2 )
+		{
+			ODD_ROUND_FI(l0,r0,k);
+			EVEN_ROUND_FI(l0,r0,k+1);
+		}
+		blocks[i] = (((u64)l0)<<32) | r0;
+	}
+}
+
+void KasumiDecryptBlocksFI( const KasumiFIKey *fk, u64 *blocks, int n )
+{
+	u32 l0, l1, l2, l3, r0, r1, r2, r3;
+	int i, k;
+
+	for( i=0; i+KASUMI_LANES<=n; i+=KASUMI_LANES )
+	{
+		l0 = (u32)(blocks[i]>>32);		r0 = (u32)blocks[i];
+		l1 = (u32)(blocks[i+1]>>32);	r1 = (u32)blocks[i+1];
+		l2 = (u32)(blocks[i+2]>>32);	r2 = (u32)blocks[i+2];
+		l3 = (u32)(blocks[i+3]>>32);	r3 = (u32)blocks[i+3];
+
+		for( k=7; k>0; k-=2 )
+		{
+			EVEN_ROUND_FI(l0,r0,k);		EVEN_ROUND_FI(l1,r1,k);
+			EVEN_ROUND_FI(l2,r2,k);		EVEN_ROUND_FI(l3,r3,k);
+			ODD_ROUND_FI(l0,r0,k-1);	ODD_ROUND_FI(l1,r1,k-1);
+			ODD_ROUND_FI(l2,r2,k-1);	ODD_ROUND_FI(l3,r3,k-1);
+		}
+
+		blocks[i] = (((u64)l0)<<32) | r0;
+		blocks[i+1] = (((u64)l1)<<32) | r1;
+		blocks[i+2] = (((u64)l2)<<32) | r2;
+		blocks[i+3] = (((u64)l3)<<32) | r3;
+	}
+
+	for( ; i<n; ++i )
+	{
+		l0 = (u32)(blocks[i]>>32);		r0 = (u32)blocks[i];
+		for( k=7; k>0; k-=2 )
+		{
+			EVEN_ROUND_FI(l0,r0,k);
+			ODD_ROUND_FI(l0,r0,k-1);
+		}
+		blocks[i] = (((u64)l0)<<32) | r0;
+	}
+}
+
+/*---------------------------------------------------------------------
+ * BlockFromBytes(), BlockToBytes()
+ * Convert between the 8-byte representation used by Kasumi() and the
+ * u64 representation used by the multi-block functions.
+ *---------------------------------------------------------------------*/
+
+u64 BlockFromBytes( u8 *data )
+{
+	u64 block = 0;
+	int n;
+
+	for( n=0; n<8; ++n )
+		block = (block<<8) | data[n];
+
+	return( block );
+}
+
+void BlockToBytes( u64 block, u8 *data )
+{
+	int n;
+
+	for( n=7; n>=0; --n )
+	{
+		data[n] = (u8)block;
+		block >>= 8;
+	}
+}
+
+/*---------------------------------------------------------------------
+ * KeySchedule_r()
+ * Build the key schedule into <ks>. Most "key" operations use 16-bit
  * subkeys so we build u16-sized arrays that are "endian" correct.
  *---------------------------------------------------------------------*/
 
-void KeySchedule( u8 *k )	// puntatore al primo char della chiave
+static const u16 C[] = {		// costanti
+	0x0123,0x4567,0x89AB,0xCDEF, 0xFEDC,0xBA98,0x7654,0x3210 
+};
+
+void KeySchedule_r( KasumiKey *ks, u8 *k )	// puntatore al primo char della chiave
 {
-	static u16 C[] = {		// costanti
-		0x0123,0x4567,0x89AB,0xCDEF, 0xFEDC,0xBA98,0x7654,0x3210 
-	};
 	u16 key[8], Kprime[8];	// la chiave è composta da 128 bit = 8 x 16 bit
 	WORD *k16;				// puntatore ad una word da 16 bit
 	int n;
@@ -352,17 +669,62 @@ void KeySchedule( u8 *k )	// puntatore al primo char della chiave
 
 	for( n=0; n<8; ++n )
 	{
-		KLi1[n] = ROL16(key[n],1);
-		KLi2[n] = Kprime[(n+2)&0x7];
-		KOi1[n] = ROL16(key[(n+1)&0x7],5);
-		KOi2[n] = ROL16(key[(n+5)&0x7],8);
-		KOi3[n] = ROL16(key[(n+6)&0x7],13);
-		KIi1[n] = Kprime[(n+4)&0x7];
-		KIi2[n] = Kprime[(n+3)&0x7];
-		KIi3[n] = Kprime[(n+7)&0x7];
+		ks->KLi1[n] = ROL16(key[n],1);
+		ks->KLi2[n] = Kprime[(n+2)&0x7];
+		ks->KOi1[n] = ROL16(key[(n+1)&0x7],5);
+		ks->KOi2[n] = ROL16(key[(n+5)&0x7],8);
+		ks->KOi3[n] = ROL16(key[(n+6)&0x7],13);
+		ks->KIi1[n] = Kprime[(n+4)&0x7];
+		ks->KIi2[n] = Kprime[(n+3)&0x7];
+		ks->KIi3[n] = Kprime[(n+7)&0x7];
 	}
 }
 
+/*---------------------------------------------------------------------
+ * KeyScheduleWord_r()
+ * Set the 16-bit key word K[<word>] (word 0 is K1) of the schedule
+ * <ks> to <value>. Only the eight subkeys that depend on that word are
+ * rewritten, so a search that changes few words of a fixed key does
+ * not need a full KeySchedule_r() per candidate.
+ *---------------------------------------------------------------------*/
+
+void KeyScheduleWord_r( KasumiKey *ks, int word, u16 value )
+{
+	u16 prime = (u16)(value ^ C[word]);
+
+	/* The same indexes as in KeySchedule_r(), solved for the round */
+
+	ks->KLi1[word] = ROL16(value,1);
+	ks->KOi1[(word+7)&0x7] = ROL16(value,5);
+	ks->KOi2[(word+3)&0x7] = ROL16(value,8);
+	ks->KOi3[(word+2)&0x7] = ROL16(value,13);
+	ks->KLi2[(word+6)&0x7] = prime;
+	ks->KIi1[(word+4)&0x7] = prime;
+	ks->KIi2[(word+5)&0x7] = prime;
+	ks->KIi3[(word+1)&0x7] = prime;
+}
+
+/*---------------------------------------------------------------------
+ * KeySchedule(), Kasumi(), KasumiDecipher()
+ * The original non-reentrant interface: the key schedule is kept in
+ * the static KasumiKey above and overwritten by every KeySchedule().
+ *---------------------------------------------------------------------*/
+
+void KeySchedule( u8 *k )
+{
+	KeySchedule_r( &K, k );
+}
+
+void Kasumi( u8 *data )
+{
+	Kasumi_r( &K, data );
+}
+
+void KasumiDecipher( u8 *data )
+{
+	KasumiDecipher_r( &K, data );
+}
+
 /*---------------------------------------------------------------------
  *				e n d   	o f 	  k a s u m i . c
  *---------------------------------------------------------------------*/
\ No newline at end of file
@@ -13,22 +13,96 @@ void KeySchedule( u8 *key );
 void Kasumi( u8 *data );
 */
 
-//#ifndef __KASUMI_H__
-//#define __KASUMI_H__
+#ifndef __KASUMI_H__
+#define __KASUMI_H__
 
 typedef unsigned char u8;
 typedef unsigned short u16;
 //typedef unsigned long u32;
 typedef unsigned int u32;
+typedef unsigned long long u64;
 
 void KeySchedule( u8 *key );
 void Kasumi( u8 *data );
 void KasumiDecipher( u8 *data );
 
+/*------- expanded key: the subkeys of the 8 rounds -----------------------*/
+
+// KeySchedule() stores the subkeys in static arrays private to Kasumi.c, so
+// only one key can be active at a time. KasumiKey holds the same arrays in a
+// caller-owned structure: every related key can be expanded once and used by
+// many threads at the same time.
+
+typedef struct {
+	u16 KLi1[8], KLi2[8];
+	u16 KOi1[8], KOi2[8], KOi3[8];
+	u16 KIi1[8], KIi2[8], KIi3[8];
+} KasumiKey;
+
+void KeySchedule_r( KasumiKey *ks, u8 *key );
+void Kasumi_r( const KasumiKey *ks, u8 *data );
+void KasumiDecipher_r( const KasumiKey *ks, u8 *data );
+
+// KeyScheduleWord_r() changes one 16-bit word of an expanded key (word 0 is
+// the first two bytes of the key) and rewrites only the 8 subkeys built from
+// it: a brute force over a few words of a fixed key can expand the key once.
+
+void KeyScheduleWord_r( KasumiKey *ks, int word, u16 value );
+
+/*------- multi-block interface -------------------------------------------*/
+
+// A block is stored in a u64 as the big-endian value of its 8 bytes: the
+// left half of KASUMI is the high 32 bits, the right half the low 32 bits.
+// KasumiTrialEncrypt() tells whether a key maps p to c; it stops after
+// round 7 when the right halves differ, as they do for nearly every key.
+
+void KasumiEncryptBlocks( const KasumiKey *ks, u64 *blocks, int n );
+void KasumiDecryptBlocks( const KasumiKey *ks, u64 *blocks, int n );
+int KasumiTrialEncrypt( const KasumiKey *ks, u64 p, u64 c );
+u64 BlockFromBytes( u8 *data );
+void BlockToBytes( u64 block, u8 *data );
+
+/*------- fused FI tables -------------------------------------------------*/
+
+// FITable() fills table[x] = FI(x, subkey) for all the 2^16 values of x
+// (128 KB). A KasumiFIKey carries, besides the subkeys, the tables of its
+// FI() functions (1 MB, released by FreeKeyScheduleFI()): the FI versions
+// of the multi-block functions do one lookup per FI(). KeyScheduleFI()
+// returns -1 when it cannot allocate the tables.
+
+typedef struct {
+	KasumiKey ks;
+	u16 *FIi1[8], *FIi2[8], *FIi3[8];
+	u16 *tables;			// the eight tables, K'1 .. K'8
+} KasumiFIKey;
+
+u16 KasumiFI( u16 in, u16 subkey );
+void FITable( u16 *table, u16 subkey );
+int KeyScheduleFI( KasumiFIKey *fk, u8 *key );
+void FreeKeyScheduleFI( KasumiFIKey *fk );
+void KasumiEncryptBlocksFI( const KasumiFIKey *fk, u64 *blocks, int n );
+void KasumiDecryptBlocksFI( const KasumiFIKey *fk, u64 *blocks, int n );
+
+/*------- bitsliced interface (KasumiBitslice.c) ---------------------------*/
+
+// Same block format as above. The blocks are processed KasumiBitsliceLanes()
+// at a time (64, 128, 256 or 512 depending on the CPU); KasumiBitsliceSetLanes()
+// forces a narrower engine (0 = widest available) and returns the one chosen.
+// KasumiBitsliceSearchKeys() returns the first i < n such that keys[i] encrypts
+// p into c, or -1: like KasumiTrialEncrypt() it compares the right halves
+// after round 7, and it never transposes the ciphertexts back.
+
+int KasumiBitsliceLanes( void );
+int KasumiBitsliceSetLanes( int n );
+void KasumiBitsliceEncrypt( u8 *key, u64 *blocks, int n );
+void KasumiBitsliceDecrypt( u8 *key, u64 *blocks, int n );
+void KasumiBitsliceEncryptKeys( u8 (*keys)[16], u64 *blocks, int n );
+int KasumiBitsliceSearchKeys( u8 (*keys)[16], u64 p, u64 c, int n );
+
 //u16 KLi1[8], KLi2[8];
 //u16 KOi1[8], KOi2[8], KOi3[8];
 //u16 KIi1[8], KIi2[8], KIi3[8];
 
 //#include <stdio.h>
 
-//#endif //__KASUMI_H__
+#endif //__KASUMI_H__
@@ -0,0 +1,211 @@
+/*-----------------------------------------------------------------------
+ *							KasumiBitslice.c
+ *-----------------------------------------------------------------------
+ *
+ * A bitsliced implementation of KASUMI: the S-boxes are evaluated as
+ * Boolean circuits and each bit lane of a register carries a different
+ * block, so one pass of the cipher transforms 64 (u64), 128 (SSE2),
+ * 256 (AVX2) or 512 (AVX-512) blocks. Every lane can also use its own
+ * key, which is what the trial encryptions of the attack need.
+ *
+ * The widest engine supported by the CPU is selected at run time;
+ * the rounds are shared by all the widths (KasumiBitsliceCore.h).
+ *
+ *-----------------------------------------------------------------------*/
+
+#include <string.h>
+#include "Kasumi.h"
+
+/* the constants C1..C8 of the key schedule */
+
+static const u16 KC[] = {
+	0x0123,0x4567,0x89AB,0xCDEF, 0xFEDC,0xBA98,0x7654,0x3210
+};
+
+/* position of key slice <b> (bit b&15 of the key word b>>4) in its 64-bit half of the key */
+
+#define KEYBIT(b)	(48 - 16*(((b)>>4)&3) + ((b)&15))
+
+/* big-endian load of 8 bytes, as BlockFromBytes() but inlined */
+
+static inline u64 Load64( const u8 *p )
+{
+	return( ((u64)p[0]<<56) | ((u64)p[1]<<48) | ((u64)p[2]<<40) | ((u64)p[3]<<32) |
+			((u64)p[4]<<24) | ((u64)p[5]<<16) | ((u64)p[6]<<8) | (u64)p[7] );
+}
+
+/*---------------------------------------------------------------------
+ * Transpose64()
+ *		Transpose a 64x64 bit matrix in place: bit j of a[i] is
+ *		swapped with bit i of a[j].
+ *---------------------------------------------------------------------*/
+
+static void Transpose64( u64 *a )
+{
+	u64 m, t;
+	int j, k;
+
+	for( j=32, m=0x00000000FFFFFFFFULL; j; j>>=1, m^=m<<j )
+	{
+		for( k=0; k<64; k=((k|j)+1)&~j )
+		{
+			t = ((a[k]>>j) ^ a[k|j]) & m;
+			a[k] ^= t<<j;
+			a[k|j] ^= t;
+		}
+	}
+}
+
+/* full scalar check of a key accepted by the round-7 filter of Search() */
+
+static int CheckKey( u8 *key, u64 p, u64 c )
+{
+	KasumiKey ks;
+
+	KeySchedule_r( &ks, key );
+	return( KasumiTrialEncrypt( &ks, p, c ) );
+}
+
+/*------- one instance of the bitsliced cipher per register width -------*/
+
+#define BS_TARGET
+#define BS_W		1
+#define BS_NAME(x)	x##64
+#define V			u64
+#include "KasumiBitsliceCore.h"
+#undef V
+#undef BS_TARGET
+#undef BS_W
+#undef BS_NAME
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KASUMI_BITSLICE_X86
+
+#define BS_TARGET	__attribute__((target("sse2")))
+#define BS_W		2
+#define BS_NAME(x)	x##128
+#define V			V128
+typedef u64 V128 __attribute__((vector_size(16)));
+#include "KasumiBitsliceCore.h"
+#undef V
+#undef BS_TARGET
+#undef BS_W
+#undef BS_NAME
+
+#define BS_TARGET	__attribute__((target("avx2")))
+#define BS_W		4
+#define BS_NAME(x)	x##256
+#define V			V256
+typedef u64 V256 __attribute__((vector_size(32)));
+#include "KasumiBitsliceCore.h"
+#undef V
+#undef BS_TARGET
+#undef BS_W
+#undef BS_NAME
+
+#define BS_TARGET	__attribute__((target("avx512f")))
+#define BS_W		8
+#define BS_NAME(x)	x##512
+#define V			V512
+typedef u64 V512 __attribute__((vector_size(64)));
+#include "KasumiBitsliceCore.h"
+#undef V
+#undef BS_TARGET
+#undef BS_W
+#undef BS_NAME
+#endif
+
+/*---------------------------------------------------------------------
+ * Engine selection
+ *---------------------------------------------------------------------*/
+
+static int lanes = 0;		// 0 = not chosen yet
+
+static int SupportedLanes( void )
+{
+#ifdef KASUMI_BITSLICE_X86
+	if( __builtin_cpu_supports("avx512f") ) return( 512 );
+	if( __builtin_cpu_supports("avx2") ) return( 256 );
+	if( __builtin_cpu_supports("sse2") ) return( 128 );
+#endif
+	return( 64 );
+}
+
+int KasumiBitsliceLanes( void )
+{
+	if( !lanes )
+		lanes = SupportedLanes();
+	return( lanes );
+}
+
+int KasumiBitsliceSetLanes( int n )
+{
+	int max = SupportedLanes();
+
+	lanes = 64;
+	while( lanes*2 <= n && lanes*2 <= max )
+		lanes *= 2;
+	if( n == 0 )
+		lanes = max;
+
+	return( lanes );
+}
+
+static void Run( u8 (*keys)[16], int perBlockKeys, u64 *blocks, int n, int decrypt )
+{
+	switch( KasumiBitsliceLanes() )
+	{
+#ifdef KASUMI_BITSLICE_X86
+	case 512:	Run512( keys, perBlockKeys, blocks, n, decrypt );	break;
+	case 256:	Run256( keys, perBlockKeys, blocks, n, decrypt );	break;
+	case 128:	Run128( keys, perBlockKeys, blocks, n, decrypt );	break;
+#endif
+	default:	Run64( keys, perBlockKeys, blocks, n, decrypt );	break;
+	}
+}
+
+/*---------------------------------------------------------------------
+ * KasumiBitsliceEncrypt(), KasumiBitsliceDecrypt()
+ *		Transform <n> blocks (u64, as in KasumiEncryptBlocks()) in
+ *		place under the 16-byte <key>.
+ * KasumiBitsliceEncryptKeys()
+ *		Encrypt blocks[i] under keys[i], for i < n.
+ *---------------------------------------------------------------------*/
+
+void KasumiBitsliceEncrypt( u8 *key, u64 *blocks, int n )
+{
+	Run( (u8 (*)[16])key, 0, blocks, n, 0 );
+}
+
+void KasumiBitsliceDecrypt( u8 *key, u64 *blocks, int n )
+{
+	Run( (u8 (*)[16])key, 0, blocks, n, 1 );
+}
+
+void KasumiBitsliceEncryptKeys( u8 (*keys)[16], u64 *blocks, int n )
+{
+	Run( keys, 1, blocks, n, 0 );
+}
+
+/*---------------------------------------------------------------------
+ * KasumiBitsliceSearchKeys()
+ *		Index of the first keys[i], i < n, that encrypts <p> into
+ *		<c>, or -1 if there is none.
+ *---------------------------------------------------------------------*/
+
+int KasumiBitsliceSearchKeys( u8 (*keys)[16], u64 p, u64 c, int n )
+{
+	switch( KasumiBitsliceLanes() )
+	{
+#ifdef KASUMI_BITSLICE_X86
+	case 512:	return( Search512( keys, p, c, n ) );
+	case 256:	return( Search256( keys, p, c, n ) );
+	case 128:	return( Search128( keys, p, c, n ) );
+#endif
+	default:	return( Search64( keys, p, c, n ) );
+	}
+}
+
+/*---------------------------------------------------------------------
+ *			e n d   	o f 	  k a s u m i b i t s l i c e . c
+ *---------------------------------------------------------------------*/
@@ -0,0 +1,414 @@
+/*---------------------------------------------------------
+ *					KasumiBitsliceCore.h
+ *---------------------------------------------------------
+ *
+ * Bitsliced KASUMI, written once for every register width.
+ * This file is not a normal header: KasumiBitslice.c includes it
+ * once per width after defining
+ *
+ *	V				the register type (u64 or a GCC vector of u64)
+ *	BS_W			number of u64 words in a V
+ *	BS_TARGET		the function attribute enabling the instruction set
+ *	BS_NAME(x)		a suffix making the function names unique
+ *
+ * A bitsliced state holds one bit of BS_W*64 different blocks in
+ * each V: slice b contains bit b (0 = least significant) of every
+ * block, block j of the batch being in bit j of the register.
+ *
+ *---------------------------------------------------------*/
+
+/*---------------------------------------------------------------------
+ * S7(), S9()
+ *		The S-boxes as Boolean functions of their input bits (the gate
+ *		equations of the specification); x[0] and y[0] are the least
+ *		significant bits.
+ *---------------------------------------------------------------------*/
+
+BS_TARGET static inline void BS_NAME(S7)( V *y, const V *x )
+{
+	V x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3], x4 = x[4], x5 = x[5], x6 = x[6];
+	V x0x1 = x0 & x1, x0x2 = x0 & x2, x1x2 = x1 & x2, x0x3 = x0 & x3;
+	V x1x3 = x1 & x3, x2x3 = x2 & x3, x0x4 = x0 & x4, x1x4 = x1 & x4;
+	V x2x4 = x2 & x4, x3x4 = x3 & x4, x0x5 = x0 & x5, x1x5 = x1 & x5;
+	V x2x5 = x2 & x5, x3x5 = x3 & x5, x4x5 = x4 & x5, x0x6 = x0 & x6;
+	V x1x6 = x1 & x6, x2x6 = x2 & x6, x3x6 = x3 & x6, x4x6 = x4 & x6;
+	V x5x6 = x5 & x6, x0x1x2 = x0x1 & x2, x0x1x3 = x0x1 & x3, x1x2x3 = x1x2 & x3;
+	V x0x1x4 = x0x1 & x4, x0x2x4 = x0x2 & x4, x1x2x4 = x1x2 & x4, x0x3x4 = x0x3 & x4;
+	V x2x3x4 = x2x3 & x4, x0x1x5 = x0x1 & x5, x0x2x5 = x0x2 & x5, x1x2x5 = x1x2 & x5;
+	V x0x3x5 = x0x3 & x5, x1x3x5 = x1x3 & x5, x2x3x5 = x2x3 & x5, x0x4x5 = x0x4 & x5;
+	V x1x4x5 = x1x4 & x5, x3x4x5 = x3x4 & x5, x0x1x6 = x0x1 & x6, x0x2x6 = x0x2 & x6;
+	V x1x2x6 = x1x2 & x6, x0x3x6 = x0x3 & x6, x1x3x6 = x1x3 & x6, x2x3x6 = x2x3 & x6;
+	V x1x4x6 = x1x4 & x6, x2x4x6 = x2x4 & x6, x3x4x6 = x3x4 & x6, x0x5x6 = x0x5 & x6;
+	V x1x5x6 = x1x5 & x6, x2x5x6 = x2x5 & x6, x4x5x6 = x4x5 & x6;
+
+	y[0] = x4 ^ x5 ^ x6 ^ x1x3 ^ x2x5 ^ x0x6 ^ x1x6 ^ x3x6 ^ x0x1x4 ^ x3x4x5 ^ x2x4x6 ^ x1x5x6 ^ x4x5x6;
+	y[1] = ~(x5 ^ x6 ^ x0x1 ^ x0x4 ^ x2x4 ^ x3x6 ^ x1x2x5 ^ x0x3x5 ^ x0x2x6 ^ x4x5x6);
+	y[2] = ~(x0 ^ x0x3 ^ x2x3 ^ x1x5 ^ x0x6 ^ x2x6 ^ x4x6 ^ x1x2x4 ^ x0x3x4 ^ x0x2x5 ^ x0x1x6);
+	y[3] = x1 ^ x1x4 ^ x3x4 ^ x0x5 ^ x2x6 ^ x0x1x2 ^ x0x1x5 ^ x2x3x5 ^ x1x4x5 ^ x1x3x6;
+	y[4] = ~(x3 ^ x0x2 ^ x1x3 ^ x1x4 ^ x0x5 ^ x1x6 ^ x3x6 ^ x5x6 ^ x0x1x4 ^ x2x3x4 ^ x1x3x5 ^ x0x4x5 ^ x0x3x6);
+	y[5] = ~(x2 ^ x0x2 ^ x0x3 ^ x0x5 ^ x2x5 ^ x4x5 ^ x1x6 ^ x1x2x3 ^ x0x2x4 ^ x1x2x6 ^ x0x3x6 ^ x3x4x6 ^ x2x5x6);
+	y[6] = x6 ^ x1x2 ^ x0x4 ^ x1x5 ^ x3x5 ^ x0x1x3 ^ x0x1x6 ^ x2x3x6 ^ x1x4x6 ^ x0x5x6;
+}
+
+BS_TARGET static inline void BS_NAME(S9)( V *y, const V *x )
+{
+	V x0 = x[0], x1 = x[1], x2 = x[2], x3 = x[3], x4 = x[4], x5 = x[5], x6 = x[6], x7 = x[7], x8 = x[8];
+	V x0x1 = x0 & x1, x0x2 = x0 & x2, x1x2 = x1 & x2, x0x3 = x0 & x3;
+	V x1x3 = x1 & x3, x2x3 = x2 & x3, x0x4 = x0 & x4, x1x4 = x1 & x4;
+	V x2x4 = x2 & x4, x3x4 = x3 & x4, x0x5 = x0 & x5, x1x5 = x1 & x5;
+	V x2x5 = x2 & x5, x3x5 = x3 & x5, x4x5 = x4 & x5, x0x6 = x0 & x6;
+	V x1x6 = x1 & x6, x2x6 = x2 & x6, x3x6 = x3 & x6, x4x6 = x4 & x6;
+	V x5x6 = x5 & x6, x0x7 = x0 & x7, x1x7 = x1 & x7, x2x7 = x2 & x7;
+	V x3x7 = x3 & x7, x4x7 = x4 & x7, x5x7 = x5 & x7, x6x7 = x6 & x7;
+	V x0x8 = x0 & x8, x1x8 = x1 & x8, x2x8 = x2 & x8, x3x8 = x3 & x8;
+	V x4x8 = x4 & x8, x5x8 = x5 & x8, x6x8 = x6 & x8, x7x8 = x7 & x8;
+
+	y[0] = ~(x3 ^ x0x2 ^ x2x5 ^ x5x6 ^ x0x7 ^ x1x7 ^ x2x7 ^ x4x8 ^ x5x8 ^ x7x8);
+	y[1] = ~(x1 ^ x6 ^ x0x1 ^ x2x3 ^ x0x4 ^ x1x4 ^ x0x5 ^ x3x5 ^ x1x7 ^ x2x7 ^ x5x8);
+	y[2] = ~(x1 ^ x8 ^ x0x3 ^ x3x4 ^ x0x5 ^ x2x6 ^ x3x6 ^ x5x6 ^ x4x7 ^ x5x7 ^ x6x7 ^ x0x8);
+	y[3] = x0 ^ x5 ^ x1x2 ^ x0x3 ^ x2x4 ^ x0x6 ^ x1x6 ^ x4x7 ^ x0x8 ^ x1x8 ^ x7x8;
+	y[4] = x4 ^ x0x1 ^ x1x3 ^ x0x5 ^ x3x6 ^ x0x7 ^ x6x7 ^ x1x8 ^ x2x8 ^ x3x8;
+	y[5] = ~(x2 ^ x1x4 ^ x4x5 ^ x0x6 ^ x1x6 ^ x3x7 ^ x4x7 ^ x6x7 ^ x5x8 ^ x6x8 ^ x7x8);
+	y[6] = x0 ^ x7 ^ x2x3 ^ x1x5 ^ x2x5 ^ x4x5 ^ x3x6 ^ x4x6 ^ x5x6 ^ x1x8 ^ x3x8 ^ x5x8 ^ x7x8;
+	y[7] = ~(x3 ^ x8 ^ x0x1 ^ x0x2 ^ x1x2 ^ x0x3 ^ x2x3 ^ x4x5 ^ x2x6 ^ x3x6 ^ x2x7 ^ x5x7);
+	y[8] = x2 ^ x7 ^ x0x1 ^ x1x2 ^ x3x4 ^ x1x5 ^ x2x5 ^ x1x6 ^ x4x6 ^ x2x8 ^ x3x8;
+}
+
+/*---------------------------------------------------------------------
+ * FI()
+ *		Same sequence of operations as FI() in Kasumi.c, on 16 slices.
+ *---------------------------------------------------------------------*/
+
+BS_TARGET static inline void BS_NAME(FI)( V *out, const V *in, const V *subkey )
+{
+	V nine[9], seven[7];
+	int k;
+
+	/* nine = S9[nine] ^ seven; seven = S7[seven] ^ (nine & 0x7F) */
+
+	BS_NAME(S9)( nine, in+7 );
+	for( k=0; k<7; ++k )
+		nine[k] ^= in[k];
+	BS_NAME(S7)( seven, in );
+	for( k=0; k<7; ++k )
+		seven[k] ^= nine[k];
+
+	/* seven ^= subkey>>9; nine ^= subkey&0x1FF */
+
+	for( k=0; k<7; ++k )
+		seven[k] ^= subkey[9+k];
+	for( k=0; k<9; ++k )
+		nine[k] ^= subkey[k];
+
+	/* nine = S9[nine] ^ seven; seven = S7[seven] ^ (nine & 0x7F) */
+
+	BS_NAME(S9)( out, nine );
+	for( k=0; k<7; ++k )
+		out[k] ^= seven[k];
+	BS_NAME(S7)( out+9, seven );
+	for( k=0; k<7; ++k )
+		out[9+k] ^= out[k];
+}
+
+/*---------------------------------------------------------------------
+ * FO(), FL()
+ *		Transform 32 slices in place (slices 16..31 are the left half).
+ *		ko[], ki[] and kl[] hold the 16 slices of each round subkey.
+ *---------------------------------------------------------------------*/
+
+BS_TARGET static inline void BS_NAME(FO)( V *x, V ko[3][16], V ki[3][16] )
+{
+	V left[16], right[16], t[16];
+	int k;
+
+	for( k=0; k<16; ++k )
+	{
+		right[k] = x[k];
+		left[k] = x[16+k];
+	}
+
+	for( k=0; k<16; ++k )
+		t[k] = left[k] ^ ko[0][k];
+	BS_NAME(FI)( left, t, ki[0] );
+	for( k=0; k<16; ++k )
+		left[k] ^= right[k];
+
+	for( k=0; k<16; ++k )
+		t[k] = right[k] ^ ko[1][k];
+	BS_NAME(FI)( right, t, ki[1] );
+	for( k=0; k<16; ++k )
+		right[k] ^= left[k];
+
+	for( k=0; k<16; ++k )
+		t[k] = left[k] ^ ko[2][k];
+	BS_NAME(FI)( left, t, ki[2] );
+	for( k=0; k<16; ++k )
+		left[k] ^= right[k];
+
+	/* the result is L3||R3 with L3 = right and R3 = left */
+
+	for( k=0; k<16; ++k )
+	{
+		x[16+k] = right[k];
+		x[k] = left[k];
+	}
+}
+
+BS_TARGET static inline void BS_NAME(FL)( V *x, V kl[2][16] )
+{
+	V *l = x+16, *r = x;
+	V a[16], b[16];
+	int k;
+
+	/* R' = R xor ROL(L and KLi1) */
+
+	for( k=0; k<16; ++k )
+		a[k] = l[k] & kl[0][k];
+	for( k=0; k<16; ++k )
+		r[k] ^= a[(k-1)&15];
+
+	/* L' = L xor ROL(R' or KLi2) */
+
+	for( k=0; k<16; ++k )
+		b[k] = r[k] | kl[1][k];
+	for( k=0; k<16; ++k )
+		l[k] ^= b[(k-1)&15];
+}
+
+/*---------------------------------------------------------------------
+ * RoundKeys()
+ *		Derive the slices of the subkeys of round <n> from the 128
+ *		slices of the key (K[16*i+b] is bit b of the key word K_i+1),
+ *		following KeySchedule_r(): rotations only move slices, and
+ *		the constants of K' only complement some of them.
+ *---------------------------------------------------------------------*/
+
+BS_TARGET static inline void BS_NAME(Prime)( V *out, const V *K, int word )
+{
+	int k;
+
+	for( k=0; k<16; ++k )
+		out[k] = ((KC[word]>>k)&1) ? ~K[16*word+k] : K[16*word+k];
+}
+
+BS_TARGET static inline void BS_NAME(RoundKeys)( const V *K, int n, V kl[2][16], V ko[3][16], V ki[3][16] )
+{
+	int k;
+
+	for( k=0; k<16; ++k )
+	{
+		kl[0][k] = K[16*n + ((k-1)&15)];
+		ko[0][k] = K[16*((n+1)&7) + ((k-5)&15)];
+		ko[1][k] = K[16*((n+5)&7) + ((k-8)&15)];
+		ko[2][k] = K[16*((n+6)&7) + ((k-13)&15)];
+	}
+
+	BS_NAME(Prime)( kl[1], K, (n+2)&7 );
+	BS_NAME(Prime)( ki[0], K, (n+4)&7 );
+	BS_NAME(Prime)( ki[1], K, (n+3)&7 );
+	BS_NAME(Prime)( ki[2], K, (n+7)&7 );
+}
+
+/*---------------------------------------------------------------------
+ * Cipher()
+ *		The first <rounds> rounds on the 64 slices of <S> (slices
+ *		32..63 are the left half), forwards or, if <decrypt>,
+ *		backwards.
+ *---------------------------------------------------------------------*/
+
+BS_TARGET static void BS_NAME(Cipher)( V *S, const V *K, int rounds, int decrypt )
+{
+	V kl[2][16], ko[3][16], ki[3][16];
+	V t[32];
+	V *left = S+32, *right = S;
+	int n, k;
+
+	for( n=0; n<rounds; ++n )
+	{
+		int round = decrypt ? 7-n : n;
+
+		BS_NAME(RoundKeys)( K, round, kl, ko, ki );
+
+		if( (round&1) == 0 )
+		{
+			/* odd rounds (1,3,5,7): right ^= FO(FL(left)) */
+
+			for( k=0; k<32; ++k )
+				t[k] = left[k];
+			BS_NAME(FL)( t, kl );
+			BS_NAME(FO)( t, ko, ki );
+			for( k=0; k<32; ++k )
+				right[k] ^= t[k];
+		}
+		else
+		{
+			/* even rounds (2,4,6,8): left ^= FL(FO(right)) */
+
+			for( k=0; k<32; ++k )
+				t[k] = right[k];
+			BS_NAME(FO)( t, ko, ki );
+			BS_NAME(FL)( t, kl );
+			for( k=0; k<32; ++k )
+				left[k] ^= t[k];
+		}
+	}
+}
+
+/*---------------------------------------------------------------------
+ * LoadKeys()
+ *		Transpose keys[0..m-1] into the 128 slices of <K>, key j in
+ *		lane j; the lanes past <m> repeat keys[0].
+ *---------------------------------------------------------------------*/
+
+BS_TARGET static inline void BS_NAME(LoadKeys)( u8 (*keys)[16], int m, V *K )
+{
+	u64 kh[BS_W][64], kL[BS_W][64], lane[BS_W];
+	int j, w, b;
+
+	for( w=0; w<BS_W; ++w )
+	{
+		for( j=0; j<64; ++j )
+		{
+			int idx = w*64 + j;
+			u8 *key = keys[(idx < m) ? idx : 0];
+			kh[w][j] = Load64( key );
+			kL[w][j] = Load64( key+8 );
+		}
+		Transpose64( kh[w] );
+		Transpose64( kL[w] );
+	}
+
+	for( b=0; b<128; ++b )
+	{
+		for( w=0; w<BS_W; ++w )
+			lane[w] = (b < 64) ? kh[w][KEYBIT(b)] : kL[w][KEYBIT(b)];
+		memcpy( &K[b], lane, sizeof(V) );
+	}
+}
+
+/*---------------------------------------------------------------------
+ * Run()
+ *		Transform <n> blocks, BS_W*64 at a time. With <perBlockKeys>
+ *		block i uses keys[i], otherwise every block uses keys[0].
+ *---------------------------------------------------------------------*/
+
+BS_TARGET static void BS_NAME(Run)( u8 (*keys)[16], int perBlockKeys, u64 *blocks, int n, int decrypt )
+{
+	V S[64], K[128];
+	u64 g[BS_W][64], lane[BS_W];
+	int lanes = 64*BS_W;
+	int i, j, w, b;
+
+	if( !perBlockKeys )
+	{
+		u64 half[2];
+
+		half[0] = Load64( keys[0] );
+		half[1] = Load64( keys[0]+8 );
+
+		for( b=0; b<128; ++b )
+		{
+			u64 bit = (half[b>>6] >> KEYBIT(b)) & 1;
+			for( w=0; w<BS_W; ++w )
+				lane[w] = 0 - bit;
+			memcpy( &K[b], lane, sizeof(V) );
+		}
+	}
+
+	for( i=0; i<n; i+=lanes )
+	{
+		int m = (n-i < lanes) ? n-i : lanes;
+
+		/* Transpose the blocks (and the keys) into slices, 64 lanes at a time */
+
+		for( w=0; w<BS_W; ++w )
+		{
+			for( j=0; j<64; ++j )
+			{
+				int idx = w*64 + j;
+				g[w][j] = (idx < m) ? blocks[i+idx] : 0;
+			}
+			Transpose64( g[w] );
+		}
+
+		for( b=0; b<64; ++b )
+		{
+			for( w=0; w<BS_W; ++w )
+				lane[w] = g[w][b];
+			memcpy( &S[b], lane, sizeof(V) );
+		}
+
+		if( perBlockKeys )
+			BS_NAME(LoadKeys)( keys+i, m, K );
+
+		BS_NAME(Cipher)( S, K, 8, decrypt );
+
+		for( b=0; b<64; ++b )
+		{
+			memcpy( lane, &S[b], sizeof(V) );
+			for( w=0; w<BS_W; ++w )
+				g[w][b] = lane[w];
+		}
+
+		for( w=0; w<BS_W; ++w )
+		{
+			Transpose64( g[w] );
+			for( j=0; j<64 && w*64+j<m; ++j )
+				blocks[i+w*64+j] = g[w][j];
+		}
+	}
+}
+
+/*---------------------------------------------------------------------
+ * Search()
+ *		Index of the first of the <n> keys that encrypts <p> into
+ *		<c>, or -1. All the lanes start from the same plaintext, so
+ *		only the keys are transposed; after round 7 the right half
+ *		is compared with the right half of <c> (round 8 does not
+ *		change it) and the rare lanes that agree are checked in full
+ *		by CheckKey().
+ *---------------------------------------------------------------------*/
+
+BS_TARGET static int BS_NAME(Search)( u8 (*keys)[16], u64 p, u64 c, int n )
+{
+	V P[64], S[64], K[128], miss;
+	u64 lane[BS_W];
+	int lanes = 64*BS_W;
+	int i, j, w, b;
+
+	for( b=0; b<64; ++b )
+	{
+		u64 bit = (p >> b) & 1;
+		for( w=0; w<BS_W; ++w )
+			lane[w] = 0 - bit;
+		memcpy( &P[b], lane, sizeof(V) );
+	}
+
+	for( i=0; i<n; i+=lanes )
+	{
+		int m = (n-i < lanes) ? n-i : lanes;
+
+		BS_NAME(LoadKeys)( keys+i, m, K );
+		memcpy( S, P, sizeof(S) );
+
+		BS_NAME(Cipher)( S, K, 7, 0 );
+
+		/* miss: the lanes whose right half differs from the one of c */
+
+		miss = ((c & 1) ? ~S[0] : S[0]);
+		for( b=1; b<32; ++b )
+			miss |= ((c >> b) & 1) ? ~S[b] : S[b];
+
+		memcpy( lane, &miss, sizeof(V) );
+		for( w=0; w<BS_W; ++w )
+		{
+			if( lane[w] == ~0ULL )
+				continue;
+			for( j=0; j<64 && w*64+j<m; ++j )
+				if( !((lane[w] >> j) & 1) && CheckKey( keys[i+w*64+j], p, c ) )
+					return( i+w*64+j );
+		}
+	}
+
+	return( -1 );
+}
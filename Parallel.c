@@ -0,0 +1,163 @@
+/*-------------------------------------------------------------------------------------------
+ *										Parallel.c
+ *-------------------------------------------------------------------------------------------
+ *
+ * A pthread pool with work-stealing chunk scheduling (see Parallel.h).
+ *
+ *-------------------------------------------------------------------------------------------*/
+
+#include <pthread.h>
+#include <unistd.h>			// sysconf()
+#include <stdlib.h>			// malloc()
+#include <stdio.h>			// fprintf()
+#include <string.h>			// strerror()
+#include "Parallel.h"
+
+static int nThreads = 0;	// 0: not chosen yet
+
+void setThreads(int n) {
+	if (n <= 0)
+		n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	nThreads = (n > 0) ? n : 1;
+}
+
+int getThreads(void) {
+	if (nThreads == 0)
+		setThreads(0);
+	return nThreads;
+}
+
+// Each worker starts with its own block of consecutive chunks and takes them from the front.
+// A worker left without chunks steals the back half of the block of another one, trying them
+// in turn from the next worker on; it leaves when every block is empty. A chunk is only ever
+// in one block, so it runs exactly once.
+
+struct pool {
+	chunkFunction f;
+	void *arg;
+	void (*progress)(double);
+	int nChunks;
+	int nWorkers;
+	struct worker *workers;
+	int done;				// chunks completed
+	int *stop;				// if not NULL and nonzero, take no more chunks
+	pthread_mutex_t lock;
+};
+
+struct worker {
+	struct pool *p;
+	int thread;
+	int first, end;			// chunks first .. end-1 still to take
+	pthread_mutex_t lock;
+};
+
+// Next chunk of w, or -1 if its block is empty
+static int takeChunk(struct worker *w) {
+	int chunk = -1;
+
+	pthread_mutex_lock(&(w -> lock));
+	if (w -> first < w -> end)
+		chunk = w -> first++;
+	pthread_mutex_unlock(&(w -> lock));
+
+	return chunk;
+}
+
+// Move the back half of the block of another worker to w and return its first chunk, or -1
+// if all the blocks are empty
+static int stealChunks(struct worker *w) {
+	struct pool *p = w -> p;
+
+	for (int i = 1; i < p -> nWorkers; i++) {
+		struct worker *victim = &(p -> workers[(w -> thread + i) % p -> nWorkers]);
+		int first, end;
+
+		pthread_mutex_lock(&(victim -> lock));
+		end = victim -> end;
+		first = victim -> first + (victim -> end - victim -> first) / 2;
+		if (first < end)
+			victim -> end = first;
+		pthread_mutex_unlock(&(victim -> lock));
+
+		if (first < end) {
+			pthread_mutex_lock(&(w -> lock));
+			w -> first = first + 1;
+			w -> end = end;
+			pthread_mutex_unlock(&(w -> lock));
+			return first;
+		}
+	}
+
+	return -1;
+}
+
+static void *work(void *arg) {
+	struct worker *w = arg;
+	struct pool *p = w -> p;
+
+	for (;;) {
+		if (p -> stop && __atomic_load_n(p -> stop, __ATOMIC_RELAXED))
+			break;
+
+		int chunk = takeChunk(w);
+		if (chunk < 0 && (chunk = stealChunks(w)) < 0)
+			break;
+
+		p -> f(p -> arg, chunk, w -> thread);
+
+		if (p -> progress) {
+			pthread_mutex_lock(&(p -> lock));
+			p -> done++;
+			p -> progress((double)(p -> done) / p -> nChunks);
+			pthread_mutex_unlock(&(p -> lock));
+		}
+	}
+
+	return NULL;
+}
+
+void parallelFor(int nChunks, chunkFunction f, void *arg, void (*progress)(double)) {
+	parallelForUntil(nChunks, f, arg, progress, NULL);
+}
+
+// If a thread cannot be started, the workers that did start (at least the calling thread)
+// steal its block
+void parallelForUntil(int nChunks, chunkFunction f, void *arg, void (*progress)(double), int *stop) {
+	int n = getThreads();
+	pthread_t *threads = malloc(n * sizeof(pthread_t));
+	struct worker *workers = malloc(n * sizeof(struct worker));
+	char *started = calloc(n, sizeof(char));
+	struct pool p = {f, arg, progress, nChunks, n, workers, 0, stop, PTHREAD_MUTEX_INITIALIZER};
+
+	// All the blocks are set before any worker can steal from them
+	for (int i = 0; i < n; i++) {
+		workers[i].p = &p;
+		workers[i].thread = i;
+		workers[i].first = (int)((long long)nChunks * i / n);
+		workers[i].end = (int)((long long)nChunks * (i + 1) / n);
+		pthread_mutex_init(&(workers[i].lock), NULL);
+	}
+
+	// The calling thread is worker 0
+	for (int i = 1; i < n; i++) {
+		int err = pthread_create(&threads[i], NULL, work, &workers[i]);
+
+		if (err != 0)
+			fprintf(stderr, "parallelFor: cannot start worker %d (%s), its chunks go to the others\n", i, strerror(err));
+		started[i] = (err == 0);
+	}
+	work(&workers[0]);
+
+	for (int i = 1; i < n; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	}
+
+	for (int i = 0; i < n; i++) {
+		pthread_mutex_destroy(&(workers[i].lock));
+	}
+	pthread_mutex_destroy(&p.lock);
+	free(started);
+	free(workers);
+	free(threads);
+}
@@ -0,0 +1,27 @@
+/*---------------------------------------------------------
+ *						Parallel.h
+ *---------------------------------------------------------*/
+
+// Minimal thread pool for the attack: the work of a phase is cut into numbered chunks.
+// Each worker thread starts on its own block of them and, once it is done, steals half of
+// what is left to another worker, until no chunk is left.
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+// f(arg, chunk, thread): process chunk <chunk> on worker <thread> (0 <= thread < getThreads())
+typedef void (*chunkFunction)(void *arg, int chunk, int thread);
+
+void setThreads(int n);		// n <= 0: one thread per online CPU
+int getThreads(void);
+
+// Run f on every chunk 0 .. nChunks-1 and wait for all of them. If progress is not NULL
+// it is called with the fraction of completed chunks, one call at a time.
+void parallelFor(int nChunks, chunkFunction f, void *arg, void (*progress)(double));
+
+// As parallelFor(), but no new chunk is started once *stop is nonzero: a worker sets it
+// (with __atomic_store_n) to make all the others leave as soon as their chunk returns.
+// Long chunks should poll *stop themselves to exit earlier.
+void parallelForUntil(int nChunks, chunkFunction f, void *arg, void (*progress)(double), int *stop);
+
+#endif //__PARALLEL_H__
@@ -0,0 +1,184 @@
+/*-------------------------------------------------------------------------------------------
+ *										Pipeline.c
+ *-------------------------------------------------------------------------------------------
+ *
+ * Phases of the attack and the bounded queues between them (see Pipeline.h).
+ *
+ *-------------------------------------------------------------------------------------------*/
+
+#include <stdio.h>			// printf()
+#include <stdlib.h>			// malloc()
+#include <string.h>			// strerror()
+#include <time.h>			// clock_gettime()
+#include "Pipeline.h"
+
+/*------------------------------------- Bounded Queue ---------------------------------------*/
+
+void initBoundedQueue(BoundedQueue *q, size_t size) {
+	q -> item = malloc(size * sizeof(void *));
+	q -> size = size;
+	q -> head = q -> count = 0;
+	q -> closed = 0;
+	pthread_mutex_init(&(q -> lock), NULL);
+	pthread_cond_init(&(q -> notFull), NULL);
+	pthread_cond_init(&(q -> notEmpty), NULL);
+}
+
+void freeBoundedQueue(BoundedQueue *q) {
+	pthread_cond_destroy(&(q -> notEmpty));
+	pthread_cond_destroy(&(q -> notFull));
+	pthread_mutex_destroy(&(q -> lock));
+	free(q -> item);
+	q -> item = NULL;
+}
+
+void pushBoundedQueue(BoundedQueue *q, void *item) {
+	pthread_mutex_lock(&(q -> lock));
+	while (q -> count == q -> size)
+		pthread_cond_wait(&(q -> notFull), &(q -> lock));
+
+	q -> item[(q -> head + q -> count) % q -> size] = item;
+	q -> count++;
+
+	pthread_cond_signal(&(q -> notEmpty));
+	pthread_mutex_unlock(&(q -> lock));
+}
+
+void *popBoundedQueue(BoundedQueue *q) {
+	void *item = NULL;
+
+	pthread_mutex_lock(&(q -> lock));
+	while (q -> count == 0 && !q -> closed)
+		pthread_cond_wait(&(q -> notEmpty), &(q -> lock));
+
+	if (q -> count > 0) {
+		item = q -> item[q -> head];
+		q -> head = (q -> head + 1) % q -> size;
+		q -> count--;
+		pthread_cond_signal(&(q -> notFull));
+	}
+	pthread_mutex_unlock(&(q -> lock));
+
+	return item;
+}
+
+void closeBoundedQueue(BoundedQueue *q) {
+	pthread_mutex_lock(&(q -> lock));
+	q -> closed = 1;
+	pthread_cond_broadcast(&(q -> notEmpty));
+	pthread_mutex_unlock(&(q -> lock));
+}
+
+/*---------------------------------------- Phases -------------------------------------------*/
+
+// The threads of a group wait until all of them are started: if one cannot be, none of the
+// phases runs, since a producer would wait forever on the queue of a consumer that is missing
+struct phaseGroup {
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	int state;				// 0: starting, 1: run, -1: a thread could not be started
+};
+
+struct phaseThread {
+	Phase *phase;
+	void *ctx;
+	int status;
+	struct phaseGroup *group;
+};
+
+double wallClock(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *runPhase(void *arg) {
+	struct phaseThread *t = arg;
+	double start = wallClock();
+
+	t -> status = t -> phase -> run(t -> ctx);
+	t -> phase -> seconds = wallClock() - start;
+	return NULL;
+}
+
+static void *runGroupPhase(void *arg) {
+	struct phaseThread *t = arg;
+	struct phaseGroup *g = t -> group;
+	int state;
+
+	pthread_mutex_lock(&(g -> lock));
+	while (g -> state == 0)
+		pthread_cond_wait(&(g -> ready), &(g -> lock));
+	state = g -> state;
+	pthread_mutex_unlock(&(g -> lock));
+
+	if (state > 0)
+		runPhase(t);
+	return NULL;
+}
+
+// The phases of a group (a phase and the ones overlapping it) run together: the first one in
+// the calling thread, the others in threads of their own
+int runPipeline(Phase phase[], int nPhases, int first, void *ctx) {
+	for (int i = 0; i < nPhases; i++) {
+		phase[i].seconds = -1;
+	}
+
+	for (int i = first, end; i < nPhases; i = end) {
+		for (end = i + 1; end < nPhases && phase[end].overlap; end++)
+			;
+
+		struct phaseGroup g = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0};
+		struct phaseThread t[end - i];
+		pthread_t threads[end - i];
+		int started = 1;
+
+		for (int k = 0; k < end - i; k++) {
+			t[k].phase = &phase[i + k];
+			t[k].ctx = ctx;
+			t[k].status = 0;
+			t[k].group = &g;
+		}
+		for (; started < end - i; started++) {
+			int err = pthread_create(&threads[started], NULL, runGroupPhase, &t[started]);
+
+			if (err != 0) {
+				fprintf(stderr, "runPipeline: cannot start phase %s (%s)\n", phase[i + started].name, strerror(err));
+				break;
+			}
+		}
+
+		pthread_mutex_lock(&(g.lock));
+		g.state = (started == end - i) ? 1 : -1;
+		pthread_cond_broadcast(&(g.ready));
+		pthread_mutex_unlock(&(g.lock));
+
+		if (g.state > 0)
+			runPhase(&t[0]);
+
+		for (int k = 1; k < started; k++)
+			pthread_join(threads[k], NULL);
+
+		pthread_cond_destroy(&(g.ready));
+		pthread_mutex_destroy(&(g.lock));
+
+		if (g.state < 0)
+			return i;
+
+		for (int k = 0; k < end - i; k++) {
+			if (t[k].status != 0)
+				return i + k;
+		}
+	}
+
+	return nPhases;
+}
+
+void printPipelineTimes(const Phase phase[], int nPhases) {
+	printf("Phase times (s):");
+	for (int i = 0; i < nPhases; i++) {
+		if (phase[i].seconds >= 0)
+			printf(" %s %.2f%s", phase[i].name, phase[i].seconds, phase[i].overlap ? " (overlapped)" : "");
+	}
+	printf("\n");
+}
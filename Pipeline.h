@@ -0,0 +1,57 @@
+/*---------------------------------------------------------
+ *						Pipeline.h
+ *---------------------------------------------------------*/
+
+// The attack as a list of phases run one after the other, each one timed on its own. A phase
+// marked overlap runs at the same time as the one before it, in its own thread, and takes its
+// input from a BoundedQueue that the earlier phase fills: the producer waits when the queue is
+// full, the consumer when it is empty, until the producer closes it.
+//
+//		Phase phases[] = {
+//			{"collect", collect, 0},
+//			{"filter", filter, 1},		// pops what collect pushes
+//			{"guess", guess, 0},
+//		};
+//		runPipeline(phases, 3, 0, &ctx);
+//		printPipelineTimes(phases, 3);
+
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <pthread.h>
+#include <stddef.h>			// size_t
+
+typedef struct {
+	void **item;			// ring of size pointers
+	size_t size;
+	size_t head;			// next item to pop
+	size_t count;
+	int closed;
+	pthread_mutex_t lock;
+	pthread_cond_t notFull, notEmpty;
+} BoundedQueue;
+
+void initBoundedQueue(BoundedQueue *q, size_t size);
+void freeBoundedQueue(BoundedQueue *q);
+void pushBoundedQueue(BoundedQueue *q, void *item);		// waits while the queue is full
+void *popBoundedQueue(BoundedQueue *q);					// waits while it is empty: NULL once it
+														// is closed and there is nothing left
+void closeBoundedQueue(BoundedQueue *q);				// no more pushes: wakes the consumer
+
+// run(ctx) returns 0 to go on with the next phase, anything else to stop the attack. A producer
+// must close its queue whatever it returns, or the phase overlapping it never ends.
+typedef struct {
+	const char *name;
+	int (*run)(void *ctx);
+	int overlap;			// run together with the previous phase
+	double seconds;			// wall-clock time, set by runPipeline() (< 0: not run)
+} Phase;
+
+// Run phases first .. nPhases-1 and return the index of the first one that stopped the
+// attack, or nPhases. A group whose threads cannot all be started is not run: the index of
+// its first phase is returned.
+int runPipeline(Phase phase[], int nPhases, int first, void *ctx);
+void printPipelineTimes(const Phase phase[], int nPhases);
+double wallClock(void);									// seconds of a monotonic clock
+
+#endif //__PIPELINE_H__
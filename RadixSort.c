@@ -0,0 +1,59 @@
+/*-------------------------------------------------------------------------------------------
+ *										RadixSort.c
+ *-------------------------------------------------------------------------------------------
+ *
+ * Stable LSD radix sort of records on a 32-bit key (see RadixSort.h): four passes of one
+ * byte each, every pass a counting sort from one buffer into the other.
+ *
+ *-------------------------------------------------------------------------------------------*/
+
+#include <string.h>			// memcpy()
+#include "Kasumi.h"			// u8, u32
+#include "RadixSort.h"
+
+static inline u32 keyOf(const u8 *record) {
+	u32 key;
+	memcpy(&key, record, sizeof(key));
+	return key;
+}
+
+void radixSort(void *records, size_t n, size_t recordSize, void *tmp) {
+	u8 *from = records, *to = tmp;
+	size_t count[4][256] = {{0}};
+
+	if (n == 0)
+		return;
+
+	// The histograms of the four bytes in a single read of the keys
+	for (size_t i = 0; i < n; i++) {
+		u32 key = keyOf(from + i * recordSize);
+		for (int b = 0; b < 4; b++)
+			count[b][(key >> (8 * b)) & 0xff]++;
+	}
+
+	for (int b = 0; b < 4; b++) {
+		size_t offset[256], sum = 0;
+
+		// A byte that is the same in every key leaves the order unchanged
+		if (count[b][(keyOf(from) >> (8 * b)) & 0xff] == n)
+			continue;
+
+		for (int d = 0; d < 256; d++) {
+			offset[d] = sum;
+			sum += count[b][d];
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			u8 *r = from + i * recordSize;
+			int d = (keyOf(r) >> (8 * b)) & 0xff;
+			memcpy(to + offset[d]++ * recordSize, r, recordSize);
+		}
+
+		u8 *swap = from;
+		from = to;
+		to = swap;
+	}
+
+	if (from != records)
+		memcpy(records, from, n * recordSize);
+}
@@ -0,0 +1,17 @@
+/*---------------------------------------------------------
+ *						RadixSort.h
+ *---------------------------------------------------------*/
+
+// LSD radix sort of fixed-size records on the u32 key stored at the start of each record.
+// The sort is stable: records with the same key keep their order, so arrays filled in
+// generation order stay in generation order inside each key.
+
+#ifndef __RADIXSORT_H__
+#define __RADIXSORT_H__
+
+#include <stddef.h>			// size_t
+
+// Sort n records of recordSize bytes; tmp must have room for n records as well.
+void radixSort(void *records, size_t n, size_t recordSize, void *tmp);
+
+#endif //__RADIXSORT_H__
@@ -11,18 +11,31 @@
 #include <time.h>    	   	// time()
 #include <math.h>          	// pow()
 #include <sys/resource.h>
+#include <unistd.h>			// getopt()
+#include <string.h>			// memcpy(), strcmp()
 #include "uthash.h"			// https://troydhanson.github.io/uthash/
 //#include "set.h"			// https://github.com/barrust/set
 //#include "set.c"
 //#include "pblSet.c"	
 #include "Kasumi.h"
+#include "Parallel.h"
+#include "FlatHash.h"
+#include "RadixSort.h"
+#include "CandidateSet.h"
+#include "Checkpoint.h"
+#include "Dataset.h"
+#include "Pipeline.h"
+
+#ifndef USE_BITSLICE
+#define USE_BITSLICE 1		// 1: the oracle and the trial encryptions use the bitsliced KASUMI
+#endif
 
 
 /*---------------------------------------- UTILITY ------------------------------------------*/
 
 struct rusage usage;
 
-static void printHex(char name[], u8 text[], int n) {
+static void printHex(char name[], const u8 text[], int n) {
 	printf("%s:\t", name);
 	for (int i = 0; i < n; i++)
 		printf("%02x ", text[i]);
@@ -52,9 +65,16 @@ char compareArray(u8 a[], u8 b[], int size)	{
 
 /*----------------------------------------- KEYS --------------------------------------------*/
 
+#define ORACLE_BATCH 4096		// blocks per oracle call (multiple of the bitsliced lanes, 512)
+#define TRIAL_BATCH 4096		// K5 guesses per trial-encryption call (must divide 2^16)
+
 static u8 *Ka;
 //static u8 Ka[16];
 static u8 Kb[16], Kc[16], Kd[16];
+static KasumiKey ksA, ksB, ksC, ksD;		// expanded once, reused by every oracle query
+#if !USE_BITSLICE
+static KasumiFIKey fkA, fkB, fkC, fkD;		// the same keys with their FI tables, for the oracle
+#endif
 
 /*-------------------------------------------------------------------------------------------
  * Let ΔK_ab = (0, 0, 8000_x, 0, 0, 0, 0, 0) and ΔK_ac = (0, 0, 0, 0, 0, 0, 8000_x , 0), and
@@ -89,105 +109,102 @@ static void generateRelatedKeys(u8 Ka[]) {
 
 /*------------------------------------ Data Collection --------------------------------------*/
 
-struct dataCollectionEntry {
-	u8 index[4];            // key:     (C_b^R)     8 Byte  
-	u8 CaCb[16];            // value:   (C_a, C_b)                          16 Byte
-	UT_hash_handle hh;      // makes this structure hashable                56 Byte
-};
-
-struct dataCollectionEntry *dataCollectionTable = NULL;
+// The pairs (C_a, C_b) indexed by C_b^R, stored inline in single slabs (FlatHash.c):
+// key (C_b^R) 4 Byte, value (C_a, C_b) 16 Byte, no per-entry malloc() or hash handle.
+// The table is split in DC_PARTITIONS tables on the top bits of the key, so that the
+// worker threads can fill different partitions at the same time.
 
-void addDataCollectionEntry(u8 index[], u8 Ca[], u8 Cb[]) {
-	struct dataCollectionEntry *h;
+#define DC_PARTITION_BITS 6
+#define DC_PARTITIONS (1 << DC_PARTITION_BITS)
+#define DC_PARTITION(key) ((key) >> (32 - DC_PARTITION_BITS))
 
-	h = malloc(sizeof(struct dataCollectionEntry));
+FlatHash dataCollectionTable[DC_PARTITIONS];
 
-	for (int i = 0; i < 8; i++) {
-		if (i < 4)
-			h -> index[i] = index[i];
-		h -> CaCb[i] = Ca[i];
-		h -> CaCb[i + 8] = Cb[i];
-	}
-
-	unsigned keylen = (unsigned)sizeof((h)->index);  
-	HASH_ADD(hh, dataCollectionTable, index[0], keylen, h);
+// Next pair (C_a, C_b) stored under key, or NULL: *cursor must be 0 at the first call
+u8 *findDataCollectionEntry(u32 key, size_t *cursor) {
+	return findFlatHash(&dataCollectionTable[DC_PARTITION(key)], key, cursor);
 }
 
-struct dataCollectionEntry *findDataCollectionEntry(u8 index[]) {
-	struct dataCollectionEntry *h;
-
-	unsigned keylen = (unsigned)sizeof((h)->index);  
-	HASH_FIND(hh, dataCollectionTable, index, keylen, h);         // h: output pointer
-
-	return h;
+void printDataCollectionEntries(void) {
+	for (int p = 0; p < DC_PARTITIONS; p++) {
+		FlatHash *t = &dataCollectionTable[p];
+
+		for (size_t s = 0; s < t -> size; s++) {
+			if ((t -> full[s / 64] >> (s % 64)) & 1) {
+				printf("Id:\t%08x\n", t -> keys[s]);
+				printHex("Ca", t -> values[s], 8);
+				printHex("Cb", t -> values[s] + 8, 8);
+			}
+		}
+	}
 }
 
-void printDataCollectionEntries(void) {
-	struct dataCollectionEntry *h;
+// Everything but the 4 + 16 bytes of each stored pair: empty slots and the slot bitmaps
+size_t dataCollectionOverhead(void) {
+	size_t bytes = 0;
 
-	for(h = dataCollectionTable; h != NULL; h = (struct dataCollectionEntry*)(h -> hh.next)) {
-		printHex("Id", h -> index, 4);
-		printHex("Ca", h -> CaCb, 8);
-		printHex("Cb", h -> CaCb + 8, 8);
+	for (int p = 0; p < DC_PARTITIONS; p++) {
+		bytes += flatHashBytes(&dataCollectionTable[p]) - dataCollectionTable[p].used * (sizeof(u32) + FLAT_HASH_VALUE);
 	}
+
+	return bytes;
 }
 
 void deleteAllDataCollectionEntries(void) {
-	struct dataCollectionEntry *currentEntry, *tmp;
-
-	HASH_ITER(hh, dataCollectionTable, currentEntry, tmp) {
-		HASH_DEL(dataCollectionTable, currentEntry);  			/* delete it (entries advances to next) */
-		free(currentEntry);             						/* free it */
+	for (int p = 0; p < DC_PARTITIONS; p++) {
+		freeFlatHash(&dataCollectionTable[p]);
 	}
 }
 
 /*------------------------------------ Right Quartets ---------------------------------------*/
 
+// The quartets live in a flat array: phase 1(b) appends them, phase 2 radix-sorts them on
+// the index and keeps the runs of at least three quartets in one linear scan.
+
 struct rightQuartetsEntry {
-	u8 index[4];            // key:     (C_a^L XOR C_c^L)		    8 Byte  
-	u8 CaCbCcCd[32];        // value:   (C_a, C_b, C_c, C_d)        32 Byte
-	UT_hash_handle hh;      // makes this structure hashable        56 Byte
+	u32 index;              // key:     (C_a^L XOR C_c^L), big-endian   4 Byte
+	u8 CaCbCcCd[32];        // value:   (C_a, C_b, C_c, C_d)            32 Byte
 };
 
-struct rightQuartetsEntry *rightQuartetsTable = NULL;
+typedef struct {
+	struct rightQuartetsEntry *entry;
+	size_t used;
+	size_t size;
+} RightQuartetsTable;
 
-void addRightQuartetsEntry(u8 index[], u8 Ca[], u8 Cb[], u8 Cc[], u8 Cd[]) {
+void addRightQuartetsEntry(RightQuartetsTable *t, u8 index[], u8 Ca[], u8 Cb[], u8 Cc[], u8 Cd[]) {
 	struct rightQuartetsEntry *h;
 
-	h = malloc(sizeof(struct rightQuartetsEntry));
+	if (t -> used == t -> size) {
+		t -> size = t -> size ? 2 * t -> size : 1 << 16;
+		t -> entry = realloc(t -> entry, t -> size * sizeof(struct rightQuartetsEntry));
+	}
+
+	h = &(t -> entry[t -> used++]);
+	h -> index = ((u32)index[0] << 24) | ((u32)index[1] << 16) | ((u32)index[2] << 8) | index[3];
 
 	for (int i = 0; i < 8; i++) {
-		if (i < 4)
-			h -> index[i] = index[i];
 		h -> CaCbCcCd[i] = Ca[i];
 		h -> CaCbCcCd[i + 8] = Cb[i];
 		h -> CaCbCcCd[i + 16] = Cc[i];
 		h -> CaCbCcCd[i + 24] = Cd[i];
 	}
-
-	unsigned keylen = (unsigned)sizeof((h)->index);  
-	HASH_ADD(hh, rightQuartetsTable, index[0], keylen, h);
 }
 
-void deleteRightQuartetsEntry(struct rightQuartetsEntry *h) {
-	HASH_DEL(rightQuartetsTable, h);
-	free(h);
-}
-
-struct rightQuartetsEntry *findRightQuartetsEntry(u8 index[]) {
-	struct rightQuartetsEntry *h;
-
-	unsigned keylen = (unsigned)sizeof((h)->index);  
-	HASH_FIND(hh, rightQuartetsTable, index, keylen, h);         // h: output pointer
-
-	return h;
+// The bytes of the index of h, as the other tables use it
+void rightQuartetIndex(const struct rightQuartetsEntry *h, u8 index[]) {
+	for (int i = 0; i < 4; i++) {
+		index[i] = (h -> index) >> (24 - 8 * i);
+	}
 }
 
-void printRightQuartetsEntries(void) {
-	struct rightQuartetsEntry *h;
+void printRightQuartetsEntries(const RightQuartetsTable *t) {
+	const struct rightQuartetsEntry *h;
+	u8 index[4];
 
-	for(h = rightQuartetsTable; h != NULL; h = (struct rightQuartetsEntry*)(h -> hh.next)) {
-		printHex("Id", h -> index, 4);
+	for (h = t -> entry; h < t -> entry + t -> used; h++) {
+		rightQuartetIndex(h, index);
+		printHex("Id", index, 4);
 		printHex("Ca", h -> CaCbCcCd, 8);
 		printHex("Cb", h -> CaCbCcCd + 8, 8);
 		printHex("Cc", h -> CaCbCcCd + 16, 8);
@@ -195,403 +212,351 @@ void printRightQuartetsEntries(void) {
 	}
 }
 
-int indexSort(struct rightQuartetsEntry *a, struct rightQuartetsEntry *b) {
-	for (int i = 0; i < 4; i++) {
-		if ((a -> index)[i] > (b -> index)[i]) {
-			return 1;
-		} else if ((a -> index)[i] < (b -> index)[i]) {
-			return -1;
-		}
-	}
-
-	return 0;
-}
-
-void sortRightQuartetsTable(void) {
-	HASH_SORT(rightQuartetsTable, indexSort);
-}
-
-void deleteAllRightQuartetsEntries(void) {
-	struct rightQuartetsEntry *currentEntry, *tmp;
-
-	HASH_ITER(hh, rightQuartetsTable, currentEntry, tmp) {
-		HASH_DEL(rightQuartetsTable, currentEntry);  			/* delete it (entries advances to next) */
-		free(currentEntry);             						/* free it */
-	}
-}
-
-/*--------------------------------------- OR^R Set ------------------------------------------*/
-
-struct OrREntry {
-	u16 key[3];     	  	// key:		(KO81, KI81, KL82)     				48 Byte
-	u8 frequency[5];		// index + freq 								40 Byte
-	UT_hash_handle hh;      // makes this structure hashable                56 Byte
-};
-
-struct OrREntry *OrRSet = NULL;
-
-struct OrREntry *findOrREntry(u16 KO81, u16 KI81, u16 KL82) {
-	struct OrREntry *h;
-	u16 key[3] = {KO81, KI81, KL82};
+// Stable: the quartets of a bin stay in insertion order
+void sortRightQuartetsTable(RightQuartetsTable *t) {
+	struct rightQuartetsEntry *tmp = malloc(t -> used * sizeof(struct rightQuartetsEntry));
 
-	unsigned keylen = (unsigned)sizeof((h)->key);  
-	HASH_FIND(hh, OrRSet, key, keylen, h);         // h: output pointer
-
-	return h;
+	radixSort(t -> entry, t -> used, sizeof(struct rightQuartetsEntry), tmp);
+	free(tmp);
 }
 
-void addOrREntry(u16 KO81, u16 KI81, u16 KL82, u8 *index) {
-	struct OrREntry *h;
-	h = findOrREntry(KO81, KI81, KL82);
-
-	if (h) {
-		// aumento la frequenza di h
-		h -> frequency[4] = (h -> frequency[4]) + 1;
-	} else {
-		h = malloc(sizeof(struct OrREntry));
+// On the sorted table: keep only the bins (runs of equal index) with at least minRun quartets
+void filterRightQuartetsTable(RightQuartetsTable *t, size_t minRun) {
+	struct rightQuartetsEntry *e = t -> entry;
+	size_t kept = 0;
 
-		h -> key[0] = KO81;
-		h -> key[1] = KI81;
-		h -> key[2] = KL82;
+	for (size_t start = 0, end; start < t -> used; start = end) {
+		for (end = start + 1; end < t -> used && e[end].index == e[start].index; end++)
+			;
 
-		for (int i = 0; i < 4; i++) {
-			h -> frequency[i] = index[i];
+		if (end - start >= minRun) {
+			memmove(&e[kept], &e[start], (end - start) * sizeof(struct rightQuartetsEntry));
+			kept += end - start;
 		}
-
-		h -> frequency[4] = 1;
-
-		unsigned keylen = (unsigned)sizeof((h)->key);  
-		HASH_ADD(hh, OrRSet, key[0], keylen, h);
 	}
-}
 
-void printOrREntries(void) {
-	struct OrREntry *h;
-
-	for(h = OrRSet; h != NULL; h = (struct OrREntry*)(h -> hh.next)) {
-		//printHex("index", h -> frequency, 4);
-		printf("(KO81, KI81^R, KL82^R, frequency):\t(%04x, %04x, %04x, %d)\n", h -> key[0], h -> key[1], h -> key[2], h -> frequency[4]);
-	}
+	t -> used = kept;
 }
 
-void deleteOrREntry(struct OrREntry *h) {
-	HASH_DEL(OrRSet, h);
-	free(h);
+void deleteAllRightQuartetsEntries(RightQuartetsTable *t) {
+	free(t -> entry);
+	t -> entry = NULL;
+	t -> used = t -> size = 0;
 }
 
-void deleteAllOrREntries(void) {
-	struct OrREntry *currentEntry, *tmp;
+// Phase 3 record of a quartet: the big-endian 16-bit halves of C_a, C_b, C_c, C_d decoded
+// once, so that the key guessing loops read them directly. 32 bytes, aligned for vector loads.
 
-	HASH_ITER(hh, OrRSet, currentEntry, tmp) {
-		HASH_DEL(OrRSet, currentEntry);  			/* delete it (entries advances to next) */
-		free(currentEntry);             						/* free it */
+enum {QA, QB, QC, QD};
+
+typedef struct {
+	u16 LL[4];				// C^LL of (C_a, C_b, C_c, C_d)
+	u16 LR[4];				// C^LR
+	u16 RL[4];				// C^RL
+	u16 RR[4];				// C^RR
+} __attribute__((aligned(32))) Quartet;
+
+void decodeQuartet(const struct rightQuartetsEntry *h, Quartet *x) {
+	for (int t = QA; t <= QD; t++) {
+		const u8 *C = h -> CaCbCcCd + 8 * t;
+
+		x -> LL[t] = (u16)(C[0] << 8) | C[1];
+		x -> LR[t] = (u16)(C[2] << 8) | C[3];
+		x -> RL[t] = (u16)(C[4] << 8) | C[5];
+		x -> RR[t] = (u16)(C[6] << 8) | C[7];
 	}
 }
 
-/*---------------------------------------- OR Set -------------------------------------------*/
-
-struct OrEntry {
-	u16 index[3];       	// key:		(KO81, KI81, KL82)     				48 Byte  
-	UT_hash_handle hh;      // makes this structure hashable                56 Byte
-};
+/*--------------------------------------- Saved Data ----------------------------------------*/
 
-struct OrEntry *OrSet = NULL;
+// The data collection of a run can be saved (Dataset.c) and given to later runs with the same
+// key: with -d the raw structures, (C, P) for each ciphertext C of structure (a) and then of (b),
+// which replace the oracle queries of phase 1; with -q the candidate quartets coming out of the
+// join, as rightQuartetsEntry records, which replace the whole of phase 1.
 
-struct OrEntry *findOrEntry(u16 KO81, u16 KI81, u16 KL82) {
-	struct OrEntry *h;
-	u16 index[3] = {KO81, KI81, KL82};
+char *structuresPath = NULL, *quartetsPath = NULL;
+const u64 (*savedStructures)[2] = NULL;		// mapped from the -d file of an earlier run
+DatasetWriter structuresWriter, quartetsWriter;
+int savingStructures = 0, savingQuartets = 0;
+u64 nSavedQuartets = 0;
 
-	unsigned keylen = (unsigned)sizeof((h)->index);  
-	HASH_FIND(hh, OrSet, index, keylen, h);         // h: output pointer
+// Tells the data of one key from those of another (FNV-1a)
+u64 keyFingerprint(const u8 K[]) {
+	u64 h = 0xcbf29ce484222325ULL;
 
+	for (int i = 0; i < 16; i++) {
+		h = (h ^ K[i]) * 0x100000001b3ULL;
+	}
 	return h;
 }
 
-void addOrEntry(u16 KO81, u16 KI81, u16 KL82) {
-	struct OrEntry *h;
+void saveQuartet(u8 index[], u8 Ca[], u8 Cb[], u8 Cc[], u8 Cd[]) {
+	struct rightQuartetsEntry r;
 
-	// As a set, we should avoid repetition of the key
-	if (!findOrEntry(KO81, KI81, KL82)) {
-		h = malloc(sizeof(struct OrEntry));
-
-		h -> index[0] = KO81;
-		h -> index[1] = KI81;
-		h -> index[2] = KL82;
+	r.index = ((u32)index[0] << 24) | ((u32)index[1] << 16) | ((u32)index[2] << 8) | index[3];
+	memcpy(r.CaCbCcCd, Ca, 8*sizeof(*Ca));
+	memcpy(r.CaCbCcCd + 8, Cb, 8*sizeof(*Cb));
+	memcpy(r.CaCbCcCd + 16, Cc, 8*sizeof(*Cc));
+	memcpy(r.CaCbCcCd + 24, Cd, 8*sizeof(*Cd));
 
-		unsigned keylen = (unsigned)sizeof((h)->index);  
-		HASH_ADD(hh, OrSet, index[0], keylen, h);
-	}
+	if (writeDatasetRecords(&quartetsWriter, nSavedQuartets++, &r, 1) != 0)
+		savingQuartets = 0;
 }
 
-void printOrEntries(void) {
-	struct OrEntry *h;
+// Every candidate quartet of phase 1(b) goes through here, into t
+void collectRightQuartet(RightQuartetsTable *t, u8 index[], u8 Ca[], u8 Cb[], u8 Cc[], u8 Cd[]) {
+	if (savingQuartets)
+		saveQuartet(index, Ca, Cb, Cc, Cd);
 
-	for(h = OrSet; h != NULL; h = (struct OrEntry*)(h -> hh.next)) {
-		printf("(KO81, KI81, KL82):\t(%04x, %04x, %04x)\n", h -> index[0], h -> index[1], h -> index[2]);
-	}
+	addRightQuartetsEntry(t, index, Ca, Cb, Cc, Cd);
 }
 
-void deleteAllOrEntries(void) {
-	struct OrEntry *currentEntry, *tmp;
+/*------------------------------------- Sort-Merge Join -------------------------------------*/
 
-	HASH_ITER(hh, OrSet, currentEntry, tmp) {
-		HASH_DEL(OrSet, currentEntry);  			/* delete it (entries advances to next) */
-		free(currentEntry);             						/* free it */
-	}
-}
+// Alternative to the hash table of the data collection (option -j sort): both structures
+// are written into flat arrays, radix-sorted on the 32-bit value they must agree on, and
+// merged. The quartets are then added in the same order as the hash path adds them.
 
-/*-------------------------------------- tmp OR Set -----------------------------------------*/
+#define JOIN_HASH 0
+#define JOIN_SORT 1
 
-struct tmpOrEntry {
-	u16 index[3];       	// key:		(KO81, KI81, KL82)     				48 Byte  
-	UT_hash_handle hh;      // makes this structure hashable                56 Byte
-};
+int joinEngine = JOIN_HASH;
 
-struct tmpOrEntry *tmpOrSet = NULL;
+struct joinRecord {
+	u32 key;				// C_b^R for (C_a, C_b), C_d^R xor 0010 0000_x for (C_c, C_d)
+	u32 seq;				// position in its structure
+	u8 pair[16];			// (C_a, C_b) or (C_c, C_d)
+};
 
-struct tmpOrEntry *findTmpOrEntry(u16 KO81, u16 KI81, u16 KL82) {
-	struct tmpOrEntry *h;
-	u16 index[3] = {KO81, KI81, KL82};
+struct joinMatch {
+	u32 seq;				// seq of the (C_c, C_d) record: the order of the hash path
+	u32 ab, cd;				// positions of the two records in the sorted arrays
+};
 
-	unsigned keylen = (unsigned)sizeof((h)->index);  
-	HASH_FIND(hh, tmpOrSet, index, keylen, h);
+struct joinRecord *joinAB, *joinCD;
+size_t nJoinAB = 0, nJoinCD = 0;
 
-	return h;
-}
+// Sort both sides, pair every (C_a, C_b) with every (C_c, C_d) of the same key and give the
+// quartets to emit(), in order. Frees the two arrays.
+void sortMergeJoin(void (*emit)(u8 index[], u8 CaCb[], u8 CcCd[], void *arg), void *arg) {
+	size_t n = (nJoinAB > nJoinCD) ? nJoinAB : nJoinCD;
+	struct joinRecord *tmp = malloc(n * sizeof(struct joinRecord));
+	struct joinMatch *matches;
+	size_t nMatches = 0, size = 1024;
 
-void addTmpOrEntry(u16 KO81, u16 KI81, u16 KL82) {
-	struct tmpOrEntry *h;
+	radixSort(joinAB, nJoinAB, sizeof(struct joinRecord), tmp);
+	radixSort(joinCD, nJoinCD, sizeof(struct joinRecord), tmp);
+	free(tmp);
 
-	if (!findTmpOrEntry(KO81, KI81, KL82)) {
-		h = malloc(sizeof(struct OrEntry));
+	matches = malloc(size * sizeof(struct joinMatch));
 
-		h -> index[0] = KO81;
-		h -> index[1] = KI81;
-		h -> index[2] = KL82;
+	for (size_t i = 0, j = 0; i < nJoinAB && j < nJoinCD; ) {
+		if (joinAB[i].key < joinCD[j].key) {
+			i++;
+		} else if (joinAB[i].key > joinCD[j].key) {
+			j++;
+		} else {
+			// Many-to-many: the runs [i, iEnd) and [j, jEnd) share the key
+			size_t iEnd = i, jEnd = j;
+			while (iEnd < nJoinAB && joinAB[iEnd].key == joinAB[i].key)
+				iEnd++;
+			while (jEnd < nJoinCD && joinCD[jEnd].key == joinCD[j].key)
+				jEnd++;
+
+			for (size_t c = j; c < jEnd; c++) {
+				for (size_t a = i; a < iEnd; a++) {
+					if (nMatches == size) {
+						size *= 2;
+						matches = realloc(matches, size * sizeof(struct joinMatch));
+					}
+					matches[nMatches].seq = joinCD[c].seq;
+					matches[nMatches].ab = (u32)a;
+					matches[nMatches].cd = (u32)c;
+					nMatches++;
+				}
+			}
 
-		unsigned keylen = (unsigned)sizeof((h)->index);  
-		HASH_ADD(hh, tmpOrSet, index[0], keylen, h);
+			i = iEnd;
+			j = jEnd;
+		}
 	}
-}
 
-void printTmpOrEntries(void) {
-	struct tmpOrEntry *h;
+	// Back to the order of the (C_c, C_d) structure; the stable sort keeps the (C_a, C_b) of
+	// each one in insertion order, as the hash table returns them
+	tmp = malloc(nMatches * sizeof(struct joinMatch));
+	radixSort(matches, nMatches, sizeof(struct joinMatch), tmp);
+	free(tmp);
 
-	for(h = tmpOrSet; h != NULL; h = (struct tmpOrEntry*)(h -> hh.next)) {
-		printf("(KO81, KI81, KL82):\t(%04x, %04x, %04x)\n", h -> index[0], h -> index[1], h -> index[2]);
-	}
-}
+	for (size_t m = 0; m < nMatches; m++) {
+		u8 *CaCb = joinAB[matches[m].ab].pair;
+		u8 *CcCd = joinCD[matches[m].cd].pair;
+		u8 indexRQ[4];
 
-void deleteAllTmpOrEntries(void) {
-	struct tmpOrEntry *currentEntry, *tmp;
+		for (int i = 0; i < 4; i++) {
+			indexRQ[i] = CaCb[i] ^ CcCd[i];		// C_a^L XOR C_c^L
+		}
 
-	HASH_ITER(hh, tmpOrSet, currentEntry, tmp) {
-		HASH_DEL(tmpOrSet, currentEntry);  			/* delete it (entries advances to next) */
-		free(currentEntry);             						/* free it */
+		emit(indexRQ, CaCb, CcCd, arg);
 	}
-}
-
-/*-------------------------------------- AND^R Set ------------------------------------------*/
-
-struct AndREntry {
-	u16 index[3];       	// key:		(KO83, KI83, KL81)     				48 Byte  
-	UT_hash_handle hh;      // makes this structure hashable                56 Byte
-};
-
-struct AndREntry *AndRSet = NULL;
-
-struct AndREntry *findAndREntry(u16 KO83, u16 KI83, u16 KL81) {
-	struct AndREntry *h;
-	u16 index[3] = {KO83, KI83, KL81};
-
-	unsigned keylen = (unsigned)sizeof((h)->index);  
-	HASH_FIND(hh, AndRSet, index, keylen, h);         
 
-	return h;
+	free(matches);
+	free(joinAB);
+	free(joinCD);
+	joinAB = joinCD = NULL;
+	nJoinAB = nJoinCD = 0;
 }
 
-void addAndREntry(u16 KO83, u16 KI83, u16 KL81) {
-	struct AndREntry *h;
+/*--------------------------------------- OR^R Set ------------------------------------------*/
 
-	if (!findAndREntry(KO83, KI83, KL81)) {
-		h = malloc(sizeof(struct AndREntry));
+// Votes of the quartets for the (KO81, KI81^R, KL82^R) triples: one counter per triple in an
+// open-addressing table (linear probing, at most half full, doubled when needed), without any
+// per-triple allocation. The top count is kept while voting, so after phase 3(a) choosing the
+// winners is one scan of the table.
 
-		h -> index[0] = KO83;
-		h -> index[1] = KI83;
-		h -> index[2] = KL81;
+struct OrREntry {
+	u64 key;				// CANDIDATE(KO81, KI81^R, KL82^R) + 1; 0: empty slot
+	u32 frequency;			// quartets suggesting the triple
+	u32 index;				// index (C_a^L XOR C_c^L) of the first of them
+};
 
-		unsigned keylen = (unsigned)sizeof((h)->index);  
-		HASH_ADD(hh, AndRSet, index[0], keylen, h);
-	}
+typedef struct {
+	struct OrREntry *entry;
+	size_t size;
+	size_t used;
+	u32 maxFrequency;		// top count so far
+} OrRVotes;
+
+static inline size_t orRSlot(u64 key, size_t size) {
+	key ^= key >> 31;
+	key *= 0x7fb5d329728ea185ULL;
+	key ^= key >> 27;
+	return key & (size - 1);
 }
 
-void printAndREntries(void) {
-	struct AndREntry *h;
+static void growOrRVotes(OrRVotes *v) {
+	struct OrREntry *old = v -> entry;
+	size_t oldSize = v -> size;
 
-	for(h = AndRSet; h != NULL; h = (struct AndREntry*)(h -> hh.next)) {
-		printf("(KO83, KI83, KL81):\t(%04x, %04x, %04x)\n", h -> index[0], h -> index[1], h -> index[2]);
-	}
-}
+	v -> size = oldSize ? 2 * oldSize : 1 << 20;
+	v -> entry = calloc(v -> size, sizeof(struct OrREntry));
 
-void deleteAllAndREntries(void) {
-	struct AndREntry *currentEntry, *tmp;
+	for (size_t i = 0; i < oldSize; i++) {
+		if (old[i].key) {
+			size_t s = orRSlot(old[i].key, v -> size);
 
-	HASH_ITER(hh, AndRSet, currentEntry, tmp) {
-		HASH_DEL(AndRSet, currentEntry);  			/* delete it (entries advances to next) */
-		free(currentEntry);             						/* free it */
+			while (v -> entry[s].key) s = (s + 1) & (v -> size - 1);
+			v -> entry[s] = old[i];
+		}
 	}
-}
-
-/*------------------------------------ tmp AND^R Set ----------------------------------------*/
-
-struct tmpAndREntry {
-	u16 index[3];       	// key:		(KO83, KI83, KL81)					48 Byte  
-	UT_hash_handle hh;      // makes this structure hashable                56 Byte
-};
-
-struct tmpAndREntry *tmpAndRSet = NULL;
-
-struct tmpAndREntry *findTmpAndREntry(u16 KO83, u16 KI83, u16 KL81) {
-	struct tmpAndREntry *h;
-	u16 index[3] = {KO83, KI83, KL81};
 
-	unsigned keylen = (unsigned)sizeof((h)->index);  
-	HASH_FIND(hh, tmpAndRSet, index, keylen, h);         
-
-	return h;
+	free(old);
 }
 
-void addTmpAndREntry(u16 KO83, u16 KI83, u16 KL81) {
-	struct tmpAndREntry *h;
-
-	if (!findTmpAndREntry(KO83, KI83, KL81)) {
-		h = malloc(sizeof(struct AndREntry));
+void addOrREntry(OrRVotes *v, u16 KO81, u16 KI81, u16 KL82, u32 index) {
+	u64 key = CANDIDATE(KO81, KI81, KL82) + 1;
+	struct OrREntry *e;
+	size_t s;
 
-		h -> index[0] = KO83;
-		h -> index[1] = KI83;
-		h -> index[2] = KL81;
-
-		unsigned keylen = (unsigned)sizeof((h)->index);  
-		HASH_ADD(hh, tmpAndRSet, index[0], keylen, h);
-	}
-}
+	if (2 * (v -> used + 1) > v -> size) growOrRVotes(v);
 
-void printTmpAndREntries(void) {
-	struct tmpAndREntry *h;
+	for (s = orRSlot(key, v -> size); v -> entry[s].key && v -> entry[s].key != key; s = (s + 1) & (v -> size - 1))
+		;
 
-	for(h = tmpAndRSet; h != NULL; h = (struct tmpAndREntry*)(h -> hh.next)) {
-		printf("(KO83, KI83, KL81):\t(%04x, %04x, %04x)\n", h -> index[0], h -> index[1], h -> index[2]);
+	e = &(v -> entry[s]);
+	if (!e -> key) {
+		e -> key = key;
+		e -> index = index;
+		v -> used++;
 	}
-}
-
-void deleteAllTmpAndREntries(void) {
-	struct tmpAndREntry *currentEntry, *tmp;
 
-	HASH_ITER(hh, tmpAndRSet, currentEntry, tmp) {
-		HASH_DEL(tmpAndRSet, currentEntry);  			/* delete it (entries advances to next) */
-		free(currentEntry);             						/* free it */
-	}
+	if (++(e -> frequency) > v -> maxFrequency) v -> maxFrequency = e -> frequency;
 }
 
-/*--------------------------------------- AND Set -------------------------------------------*/
-
-struct AndEntry {
-	u16 index[3];       	// key:		(KO83, KI83, KL81)     				48 Byte  
-	UT_hash_handle hh;      // makes this structure hashable                56 Byte
-};
-
-struct AndEntry *AndSet = NULL;
-
-struct AndEntry *findAndEntry(u16 KO83, u16 KI83, u16 KL81) {
-	struct AndEntry *h;
-	u16 index[3] = {KO83, KI83, KL81};
+static int compareOrREntries(const void *a, const void *b) {
+	const struct OrREntry *x = a, *y = b;
 
-	unsigned keylen = (unsigned)sizeof((h)->index);  
-	HASH_FIND(hh, AndSet, index, keylen, h);         
-
-	return h;
+	if (x -> index != y -> index) return (x -> index > y -> index) - (x -> index < y -> index);
+	return (x -> key > y -> key) - (x -> key < y -> key);
 }
 
-void addAndEntry(u16 KO83, u16 KI83, u16 KL81) {
-	struct AndEntry *h;
-
-	if (!findAndEntry(KO83, KI83, KL81)) {
-		h = malloc(sizeof(struct AndEntry));
+// Keep only the triples with the top count, packed at the start of v -> entry (which is no
+// longer a hash table) in (index, KO81, KI81^R, KL82^R) order. Returns the index of the first of
+// them: the quartets are sorted on the index and each one votes in key order, so it is the first
+// triple to reach the top count in voting order. No triple: the index of the first quartet of t.
+u32 keepMostFrequentOrREntries(OrRVotes *v, const RightQuartetsTable *t) {
+	size_t kept = 0;
 
-		h -> index[0] = KO83;
-		h -> index[1] = KI83;
-		h -> index[2] = KL81;
-
-		unsigned keylen = (unsigned)sizeof((h)->index);  
-		HASH_ADD(hh, AndSet, index[0], keylen, h);
+	for (size_t i = 0; i < v -> size; i++) {
+		if (v -> entry[i].key && v -> entry[i].frequency == v -> maxFrequency) {
+			v -> entry[kept++] = v -> entry[i];
+		}
 	}
-}
 
-void printAndEntries(void) {
-	struct AndEntry *h;
+	v -> used = kept;
+	qsort(v -> entry, v -> used, sizeof(struct OrREntry), compareOrREntries);
 
-	for(h = AndSet; h != NULL; h = (struct AndEntry*)(h -> hh.next)) {
-		printf("(KO83, KI83, KL81):\t(%04x, %04x, %04x)\n", h -> index[0], h -> index[1], h -> index[2]);
-	}
+	return v -> used ? v -> entry[0].index : t -> entry[0].index;
 }
 
-void deleteAllAndEntries(void) {
-	struct AndEntry *currentEntry, *tmp;
-
-	HASH_ITER(hh, AndSet, currentEntry, tmp) {
-		HASH_DEL(AndSet, currentEntry);  			/* delete it (entries advances to next) */
-		free(currentEntry);             						/* free it */
+// (works after keepMostFrequentOrREntries())
+void printOrREntries(const OrRVotes *v) {
+	for (size_t i = 0; i < v -> used; i++) {
+		u64 c = v -> entry[i].key - 1;
+		printf("(KO81, KI81^R, KL82^R, frequency):\t(%04x, %04x, %04x, %u)\n", CANDIDATE_KO(c), CANDIDATE_KI(c), CANDIDATE_KL(c), v -> entry[i].frequency);
 	}
 }
 
-/*------------------------------------- tmp AND Set -----------------------------------------*/
-
-struct tmpAndEntry {
-	u16 index[3];       	// key:		(KO83, KI83, KL81)					48 Byte  
-	UT_hash_handle hh;      // makes this structure hashable                56 Byte
-};
+// Put back an entry saved by a checkpoint, with its count
+void restoreOrREntry(OrRVotes *v, const struct OrREntry *e) {
+	size_t s;
 
-struct tmpAndEntry *tmpAndSet = NULL;
+	if (2 * (v -> used + 1) > v -> size) growOrRVotes(v);
 
-struct tmpAndEntry *findTmpAndEntry(u16 KO83, u16 KI83, u16 KL81) {
-	struct tmpAndEntry *h;
-	u16 index[3] = {KO83, KI83, KL81};
+	for (s = orRSlot(e -> key, v -> size); v -> entry[s].key; s = (s + 1) & (v -> size - 1))
+		;
 
-	unsigned keylen = (unsigned)sizeof((h)->index);  
-	HASH_FIND(hh, tmpAndSet, index, keylen, h);         
+	v -> entry[s] = *e;
+	v -> used++;
+	if (e -> frequency > v -> maxFrequency) v -> maxFrequency = e -> frequency;
+}
 
-	return h;
+void deleteAllOrREntries(OrRVotes *v) {
+	free(v -> entry);
+	v -> entry = NULL;
+	v -> size = v -> used = 0;
+	v -> maxFrequency = 0;
 }
 
-void addTmpAndEntry(u16 KO83, u16 KI83, u16 KL81) {
-	struct tmpAndEntry *h;
+/*------------------------------------- Candidate Sets --------------------------------------*/
 
-	if (!findTmpAndEntry(KO83, KI83, KL81)) {
-		h = malloc(sizeof(struct AndEntry));
+// The triples suggested by every quartet analyzed so far: OrSet (KO81, KI81, KL82), AndRSet
+// (KO83, KI83^R, KL81^R) and AndSet (KO83, KI83, KL81). Each quartet fills its own set, which
+// is then intersected in place with the one of the previous quartets.
 
-		h -> index[0] = KO83;
-		h -> index[1] = KI83;
-		h -> index[2] = KL81;
+// Add the candidates of the quartet n. cont, sealed, to *set
+void mergeCandidates(CandidateSet *set, CandidateSet *quartet, int cont) {
+	sealCandidateSet(quartet);
 
-		unsigned keylen = (unsigned)sizeof((h)->index);  
-		HASH_ADD(hh, tmpAndSet, index[0], keylen, h);
+	if (cont == 1) {
+		freeCandidateSet(set);
+		*set = *quartet;
+		initCandidateSet(quartet);
+	} else {
+		intersectCandidateSet(set, quartet);
 	}
 }
 
-void printTmpAndEntries(void) {
-	struct tmpAndEntry *h;
-
-	for(h = tmpAndSet; h != NULL; h = (struct tmpAndEntry*)(h -> hh.next)) {
-		printf("(KO83, KI83, KL81):\t(%04x, %04x, %04x)\n", h -> index[0], h -> index[1], h -> index[2]);
+void printOrEntries(const CandidateSet *OrSet) {
+	for (size_t i = 0; i < OrSet -> used; i++) {
+		u64 c = OrSet -> key[i];
+		printf("(KO81, KI81, KL82):\t(%04x, %04x, %04x)\n", CANDIDATE_KO(c), CANDIDATE_KI(c), CANDIDATE_KL(c));
 	}
 }
 
-void deleteAllTmpAndEntries(void) {
-	struct tmpAndEntry *currentEntry, *tmp;
-
-	HASH_ITER(hh, tmpAndSet, currentEntry, tmp) {
-		HASH_DEL(tmpAndSet, currentEntry);  			/* delete it (entries advances to next) */
-		free(currentEntry);             						/* free it */
+void printAndEntries(const CandidateSet *AndSet) {
+	for (size_t i = 0; i < AndSet -> used; i++) {
+		u64 c = AndSet -> key[i];
+		printf("(KO83, KI83, KL81):\t(%04x, %04x, %04x)\n", CANDIDATE_KO(c), CANDIDATE_KI(c), CANDIDATE_KL(c));
 	}
 }
 
@@ -602,9 +567,9 @@ struct SubkeysEntry {
 	UT_hash_handle hh;      // makes this structure hashable                	56 Byte
 };
 
-struct SubkeysEntry *SubkeysSet = NULL;
+// The sets are uthash tables: a set is the pointer to its first entry, NULL when empty
 
-struct SubkeysEntry *findSubkeysEntry(u16 KO81, u16 KI81, u16 KL82, u16 KO83, u16 KI83, u16 KL81) {
+struct SubkeysEntry *findSubkeysEntry(struct SubkeysEntry *SubkeysSet, u16 KO81, u16 KI81, u16 KL82, u16 KO83, u16 KI83, u16 KL81) {
 	struct SubkeysEntry *h;
 	u16 index[6] = {KO81, KI81, KL82, KO83, KI83, KL81};
 
@@ -614,10 +579,10 @@ struct SubkeysEntry *findSubkeysEntry(u16 KO81, u16 KI81, u16 KL82, u16 KO83, u1
 	return h;
 }
 
-void addSubkeysEntry(u16 KO81, u16 KI81, u16 KL82, u16 KO83, u16 KI83, u16 KL81) {
+void addSubkeysEntry(struct SubkeysEntry **SubkeysSet, u16 KO81, u16 KI81, u16 KL82, u16 KO83, u16 KI83, u16 KL81) {
 	struct SubkeysEntry *h;
 
-	if (!findSubkeysEntry(KO81, KI81, KL82, KO83, KI83, KL81)) {
+	if (!findSubkeysEntry(*SubkeysSet, KO81, KI81, KL82, KO83, KI83, KL81)) {
 		h = malloc(sizeof(struct SubkeysEntry));
 
 		h -> index[0] = KO81;
@@ -628,11 +593,11 @@ void addSubkeysEntry(u16 KO81, u16 KI81, u16 KL82, u16 KO83, u16 KI83, u16 KL81)
 		h -> index[5] = KL81;
 
 		unsigned keylen = (unsigned)sizeof((h)->index);  
-		HASH_ADD(hh, SubkeysSet, index[0], keylen, h);
+		HASH_ADD(hh, *SubkeysSet, index[0], keylen, h);
 	}
 }
 
-void printSubkeysEntries(void) {
+void printSubkeysEntries(struct SubkeysEntry *SubkeysSet) {
 	struct SubkeysEntry *h;
 
 	for(h = SubkeysSet; h != NULL; h = (struct SubkeysEntry*)(h -> hh.next)) {
@@ -641,87 +606,181 @@ void printSubkeysEntries(void) {
 	}
 }
 
-void deleteAllSubkeysEntries(void) {
+void deleteAllSubkeysEntries(struct SubkeysEntry **SubkeysSet) {
 	struct SubkeysEntry *currentEntry, *tmp;
 
-	HASH_ITER(hh, SubkeysSet, currentEntry, tmp) {
-		HASH_DEL(SubkeysSet, currentEntry);  			/* delete it (entries advances to next) */
+	HASH_ITER(hh, *SubkeysSet, currentEntry, tmp) {
+		HASH_DEL(*SubkeysSet, currentEntry);  			/* delete it (entries advances to next) */
 		free(currentEntry);             						/* free it */
 	}
 }
 
-/*-------------------------------------- KL82 / KL81 ---------------------------------------*/
+/*--------------------------------------- Attack Run ----------------------------------------*/
+
+// The attack is a pipeline of phases (Pipeline.c), each one timed on its own. The phases share
+// nothing but a struct attackRun: each one reads its inputs from its fields and leaves its
+// outputs there.
+//		collect		phase 1, the oracle queries (or a -d file). In: the keys, seed, structures.
+//					Out: the candidate quartets, pushed in batches on quartets.
+//		filter		phase 2, run together with phase 1. In: quartets.
+//					Out: rightQuartets, the bins of at least three quartets.
+//		guess KL82	phase 3(a). In: rightQuartets, votes. Out: OrSet, and in rightQuartets
+//					only the right quartets left.
+//		guess KL81	phase 3(b). In: OrSet, rightQuartets, swept. Out: SubkeysSet.
+//		search		phase 4. In: SubkeysSet. Out: found and the key printed.
+// A phase returns nonzero when the attack cannot go on. The inputs of a resumed phase come from
+// the checkpoint (see below) instead.
+
+enum {STAGE_3A = 1, STAGE_3B, STAGE_4};
+
+struct checkpointState {
+	u32 stage;
+	u32 cursor;
+	u32 chunk;				// phase 4: first K3 chunk left in set cursor + 1
+	u32 reserved;
+	u64 seed;				// seed of the run, printed again on resume
+};
+
+struct attackRun {
+	int nPlaintext;
+	u64 seed;							// state of the seed sequence of the structures
+	struct checkpointState resume;		// stage 0: a new run
+	Dataset structures, candidates;		// data of an earlier run (-d, -q), if any
+	BoundedQueue quartets;				// collect -> filter: struct quartetBatch *
+	int collectFailed;					// phase 1 stopped: the filter must not go on
+	RightQuartetsTable rightQuartets;	// filter -> guess KL82 -> guess KL81
+	OrRVotes votes;						// guess KL82, up to its checkpoint
+	CandidateSet OrSet;					// guess KL82 -> guess KL81
+	u16 (*swept)[4];					// guess KL81: (candidate, KO83, KI83^R, KL81^R) of the
+	size_t nSwept, sizeSwept;			// candidates already swept, up to its checkpoint
+	struct SubkeysEntry *SubkeysSet;	// guess KL81 -> search
+	int found;
+};
+
+/*--------------------------------------- Checkpoint ----------------------------------------*/
+
+// With -c the state of phases 3 and 4 is saved in a checkpoint file (Checkpoint.c), and a run
+// given the same file resumes from it. The stage says where to restart and the cursor how far
+// the stage had got: quartets analyzed in phase 3(a), values of (KO81, KI81) swept in phase 3(b)
+// (with what each sweep found), sets of subkeys tried in phase 4, with the K3 chunks already
+// searched in the next set. The data collection is not saved: only its right quartets.
+
+#define TAG_STATE		CHECKPOINT_TAG('S', 'T', 'A', 'T')
+#define TAG_QUARTETS	CHECKPOINT_TAG('Q', 'R', 'T', 'S')		// rightQuartets
+#define TAG_ORR			CHECKPOINT_TAG('O', 'R', 'R', 'S')		// votes (phase 3(a))
+#define TAG_OR			CHECKPOINT_TAG('O', 'R', 'S', 'T')		// OrSet (phase 3(b))
+#define TAG_SUBKEYS		CHECKPOINT_TAG('S', 'U', 'B', 'K')		// SubkeysSet, in insertion order
+#define TAG_SWEPT		CHECKPOINT_TAG('S', 'W', 'P', 'T')		// swept (phase 3(b))
+
+char *checkpointPath = NULL;
+int checkpointInterval = 300;	// seconds between two checkpoints inside a stage
+u64 checkpointSeed;
+static time_t lastCheckpoint;
+
+// Called at the start of each stage (force) and after each step of it: the steps only write
+// the checkpoint once checkpointInterval seconds have passed since the last one
+void saveCheckpoint(const struct attackRun *run, u32 stage, u32 cursor, u32 chunk, int force) {
+	struct checkpointState state = {stage, cursor, chunk, 0, checkpointSeed};
+	Checkpoint c;
+
+	if (checkpointPath == NULL || (!force && time(NULL) - lastCheckpoint < checkpointInterval))
+		return;
+
+	beginCheckpoint(&c);
+	addCheckpointSection(&c, TAG_STATE, &state, sizeof(state));
+	addCheckpointSection(&c, TAG_QUARTETS, run -> rightQuartets.entry, run -> rightQuartets.used * sizeof(struct rightQuartetsEntry));
+
+	if (stage == STAGE_3A) {
+		const OrRVotes *v = &(run -> votes);
+		struct OrREntry *votes = malloc(v -> used * sizeof(struct OrREntry));
+		size_t n = 0;
+
+		for (size_t i = 0; i < v -> size; i++) {
+			if (v -> entry[i].key) votes[n++] = v -> entry[i];
+		}
+		addCheckpointSection(&c, TAG_ORR, votes, n * sizeof(struct OrREntry));
+		free(votes);
+	} else {
+		u16 (*subkeys)[6] = malloc(HASH_COUNT(run -> SubkeysSet) * sizeof(u16[6]));
+		struct SubkeysEntry *h;
+		size_t n = 0;
+
+		for (h = run -> SubkeysSet; h != NULL; h = h -> hh.next) {
+			memcpy(subkeys[n++], h -> index, sizeof(h -> index));
+		}
+		addCheckpointSection(&c, TAG_OR, run -> OrSet.key, run -> OrSet.used * sizeof(u64));
+		if (stage == STAGE_3B && run -> nSwept > 0)
+			addCheckpointSection(&c, TAG_SWEPT, run -> swept, run -> nSwept * sizeof(u16[4]));
+		addCheckpointSection(&c, TAG_SUBKEYS, subkeys, n * sizeof(u16[6]));
+		free(subkeys);
+	}
+
+	if (writeCheckpoint(&c, checkpointPath) == 0) {
+		lastCheckpoint = time(NULL);
+	} else {
+		printf("Cannot write the checkpoint %s: going on without it\n", checkpointPath);
+	}
+}
+
+// Reload into run the state and the tables saved by saveCheckpoint(): 0 on success, -1 if
+// there is no usable checkpoint (the attack then starts from the beginning)
+int loadCheckpoint(struct attackRun *run) {
+	struct checkpointState *state = &(run -> resume);
+	Checkpoint c;
+	const void *p;
+	size_t bytes;
+
+	if (checkpointPath == NULL || readCheckpoint(&c, checkpointPath) != 0)
+		return -1;
+
+	if ((p = findCheckpointSection(&c, TAG_STATE, &bytes)) == NULL || bytes != sizeof(*state) ||
+		findCheckpointSection(&c, TAG_QUARTETS, &bytes) == NULL) {
+		fprintf(stderr, "%s: incomplete checkpoint\n", checkpointPath);
+		freeCheckpoint(&c);
+		return -1;
+	}
+	memcpy(state, p, sizeof(*state));
+
+	p = findCheckpointSection(&c, TAG_QUARTETS, &bytes);
+	run -> rightQuartets.used = run -> rightQuartets.size = bytes / sizeof(struct rightQuartetsEntry);
+	run -> rightQuartets.entry = malloc(bytes);
+	memcpy(run -> rightQuartets.entry, p, bytes);
+
+	if (state -> stage == STAGE_3A) {
+		const struct OrREntry *votes = findCheckpointSection(&c, TAG_ORR, &bytes);
+
+		for (size_t i = 0; votes && i < bytes / sizeof(struct OrREntry); i++) {
+			restoreOrREntry(&(run -> votes), &votes[i]);
+		}
+	} else {
+		const u64 *or = findCheckpointSection(&c, TAG_OR, &bytes);
+		const u16 (*subkeys)[6];
+
+		// Saved sealed: appending keeps the order
+		for (size_t i = 0; or && i < bytes / sizeof(u64); i++) {
+			addCandidate(&(run -> OrSet), or[i]);
+		}
+
+		subkeys = findCheckpointSection(&c, TAG_SUBKEYS, &bytes);
+		for (size_t i = 0; subkeys && i < bytes / sizeof(u16[6]); i++) {
+			const u16 *k = subkeys[i];
+			addSubkeysEntry(&(run -> SubkeysSet), k[0], k[1], k[2], k[3], k[4], k[5]);
+		}
+
+		if (state -> stage == STAGE_3B && (p = findCheckpointSection(&c, TAG_SWEPT, &bytes)) != NULL && bytes > 0) {
+			run -> nSwept = run -> sizeSwept = bytes / sizeof(u16[4]);
+			run -> swept = malloc(bytes);
+			memcpy(run -> swept, p, bytes);
+		}
+	}
 
-/*-------------------------------------- FI Function ---------------------------------------*/
-
-static u16 FI(u16 in, u16 subkey) {
-	u16 nine, seven;
-
-	static u16 S7[] = {
-		54, 50, 62, 56, 22, 34, 94, 96, 38,  6, 63, 93,  2, 18,123, 33,
-		55,113, 39,114, 21, 67, 65, 12, 47, 73, 46, 27, 25,111,124, 81,
-		53,  9,121, 79, 52, 60, 58, 48,101,127, 40,120,104, 70, 71, 43,
-		20,122, 72, 61, 23,109, 13,100, 77,  1, 16,  7, 82, 10,105, 98,
-		117,116, 76, 11, 89,106, 0,125,118, 99, 86, 69, 30, 57,126, 87,
-		112, 51, 17,  5, 95, 14, 90, 84, 91, 8, 35,103, 32, 97, 28, 66,
-		102, 31, 26, 45, 75, 4, 85, 92, 37, 74, 80, 49, 68, 29,115, 44,
-		64,107,108, 24,110, 83, 36, 78, 42, 19, 15, 41, 88,119, 59,  3};
-	static u16 S9[] = {
-		167,239,161,379,391,334,  9,338, 38,226, 48,358,452,385, 90,397,
-		183,253,147,331,415,340, 51,362,306,500,262, 82,216,159,356,177,
-		175,241,489, 37,206, 17,  0,333, 44,254,378, 58,143,220, 81,400,
-		 95,  3,315,245, 54,235,218,405,472,264,172,494,371,290,399, 76,
-		165,197,395,121,257,480,423,212,240, 28,462,176,406,507,288,223,
-		501,407,249,265, 89,186,221,428,164, 74,440,196,458,421,350,163,
-		232,158,134,354, 13,250,491,142,191, 69,193,425,152,227,366,135,
-		344,300,276,242,437,320,113,278, 11,243, 87,317, 36, 93,496, 27,
-		487,446,482, 41, 68,156,457,131,326,403,339, 20, 39,115,442,124,
-		475,384,508, 53,112,170,479,151,126,169, 73,268,279,321,168,364,
-		363,292, 46,499,393,327,324, 24,456,267,157,460,488,426,309,229,
-		439,506,208,271,349,401,434,236, 16,209,359, 52, 56,120,199,277,
-		465,416,252,287,246,  6, 83,305,420,345,153,502, 65, 61,244,282,
-		173,222,418, 67,386,368,261,101,476,291,195,430, 49, 79,166,330,
-		280,383,373,128,382,408,155,495,367,388,274,107,459,417, 62,454,
-		132,225,203,316,234, 14,301, 91,503,286,424,211,347,307,140,374,
-		 35,103,125,427, 19,214,453,146,498,314,444,230,256,329,198,285,
-		 50,116, 78,410, 10,205,510,171,231, 45,139,467, 29, 86,505, 32,
-		 72, 26,342,150,313,490,431,238,411,325,149,473, 40,119,174,355,
-		185,233,389, 71,448,273,372, 55,110,178,322, 12,469,392,369,190,
-		  1,109,375,137,181, 88, 75,308,260,484, 98,272,370,275,412,111,
-		336,318,  4,504,492,259,304, 77,337,435, 21,357,303,332,483, 18,
-		 47, 85, 25,497,474,289,100,269,296,478,270,106, 31,104,433, 84,
-		414,486,394, 96, 99,154,511,148,413,361,409,255,162,215,302,201,
-		266,351,343,144,441,365,108,298,251, 34,182,509,138,210,335,133,
-		311,352,328,141,396,346,123,319,450,281,429,228,443,481, 92,404,
-		485,422,248,297, 23,213,130,466, 22,217,283, 70,294,360,419,127,
-		312,377,  7,468,194,  2,117,295,463,258,224,447,247,187, 80,398,
-		284,353,105,390,299,471,470,184, 57,200,348, 63,204,188, 33,451,
-		 97, 30,310,219, 94,160,129,493, 64,179,263,102,189,207,114,402,
-		438,477,387,122,192, 42,381,  5,145,118,180,449,293,323,136,380,
-		 43, 66, 60,455,341,445,202,432,  8,237, 15,376,436,464, 59,461};
-
-	/* The sixteen bit input is split into two unequal halves, 	*
-	 * nine bits and seven bits - as is the subkey			   	*/
-
-	nine = (u16)(in>>7);		
-	seven = (u16)(in&0x7F);		
-
-	/* Now run the various operations */
-
-	nine = (u16)(S9[nine] ^ seven);				
-	seven = (u16)(S7[seven] ^ (nine & 0x7F));
-
-	seven ^= (subkey>>9);		
-	nine ^= (subkey&0x1FF);		
-
-	nine = (u16)(S9[nine] ^ seven);
-	seven = (u16)(S7[seven] ^ (nine & 0x7F));
-
-	in = (u16)((seven<<9) + nine);
-
-	return(in);
+	freeCheckpoint(&c);
+	lastCheckpoint = time(NULL);
+	return 0;
 }
 
+/*-------------------------------------- KL82 / KL81 ---------------------------------------*/
+
 u16 rightRotate(u16 n, unsigned int d) {
 	return (n >> d) | (n << (16 - d));
 }
@@ -732,7 +791,7 @@ u16 rightRotate(u16 n, unsigned int d) {
  * 	- 2 	: the guessed bit can be both 0 and 1 			*
  *	- 3 	: there is not a possible guessing for the key 	*/
 
-static short OR[] = 
+static const short OR[] = 
 {
   2, 3, 1, 0,
   3, 3, 3, 3,
@@ -740,7 +799,7 @@ static short OR[] =
   0, 3, 3, 0
 };
 
-static short AND[] = 
+static const short AND[] = 
 {
   2, 3, 0, 1,
   3, 3, 3, 3,
@@ -748,616 +807,1064 @@ static short AND[] =
   1, 3, 3, 1
 };
 
-/*------------------------------------- Dynamic Array --------------------------------------*/
-// https://stackoverflow.com/questions/3536153/c-dynamically-growing-array
+/*------------------------------------ KL Candidate Set ------------------------------------*/
 
-typedef struct {
-	int *array;
-	size_t used;
-	size_t size;
-} Array;
+// The candidates for a 16-bit KL subkey given by a lookup table: the keys k with
+// (k & ~free) == fixed, enumerated only when they are used
 
-void initArray(Array *a, size_t initialSize) {
-	a -> array = malloc(initialSize * sizeof(int));
-	a -> used = 0;
-	a -> size = initialSize;
-}
+#define KL_R 0x80ff			// positions of KL^R (bits 0-7 and 15)
+#define KL_L 0x7f00			// positions of KL^L (bits 8-14)
 
-void insertArray(Array *a, int element) {
-	// a->used is the number of used entries, because a->array[a->used++] updates a->used only *after* the array has been accessed.
-	// Therefore a->used can go up to a->size 
-	if (a -> used == a -> size) {
-		a -> size *= 2;
-		a -> array = realloc(a -> array, a -> size * sizeof(int));
-	}
-	a -> array[a -> used++] = element;
-}
+typedef struct {
+	u16 fixed;				// value of the bits outside free
+	u16 free;				// bits that can be both 0 and 1
+	u16 empty;				// positions without a possible guessing: no candidate if nonzero
+} KLSet;
+
+/*--------------------------------- Constraint Evaluator -----------------------------------*/
+
+// Look up the OR/AND table for all the 16 positions at once: c = 4*i + j selects the
+// positions whose bits of (Xac, Yac, Xbd, Ybd) are the bits of c, and table[c] says which
+// word they go to. T is u16 for one guess, or a vector of u16 for one guess per lane; with
+// the table known at compile time each c folds to a few AND/OR.
+
+#define KL_EVALUATE(table, T, Xac, Yac, Xbd, Ybd, r) do {											\
+	_Pragma("GCC unroll 16")																	\
+	for (int c = 0; c < 16; c++) {																\
+		T sel = (c & 8 ? (Xac) : ~(Xac)) & (c & 4 ? (Yac) : ~(Yac)) &							\
+		        (c & 2 ? (Xbd) : ~(Xbd)) & (c & 1 ? (Ybd) : ~(Ybd));							\
+																								\
+		switch ((table)[c]) {																	\
+			case 0:  (r).zero |= sel; break;													\
+			case 1:  (r).one |= sel; break;														\
+			case 2:  (r).free |= sel; break;													\
+			default: (r).none |= sel; break;													\
+		}																						\
+	}																							\
+} while (0)
 
-void freeArray(Array *a) {
-	free(a -> array);
-	a -> array = NULL;
-	a -> used = a -> size = 0;
-}
+typedef struct {
+	u16 none;				// positions without a possible guessing
+	u16 zero;				// positions where the key bit must be 0
+	u16 one;				// positions where the key bit must be 1
+	u16 free;				// positions where the key bit can be both 0 and 1
+} KLConstraint;
 
-/*--------------------------------------- Find KL82 ----------------------------------------*/
+static inline KLConstraint evaluateKL(const short table[], u16 Xac, u16 Yac, u16 Xbd, u16 Ybd) {
+	KLConstraint r = {0, 0, 0, 0};
 
-Array findKL82R(u8 *Ca, u8 *Cb, u8 *Cc, u8 *Cd, u16 KO81, u16 KI81) {
+	KL_EVALUATE(table, u16, Xac, Yac, Xbd, Ybd, r);
+	return r;
+}
 
-	// Finding input and output differences of the OR operator for bot the coupples of texts
-	// Ca^LL = (u16)(Ca[0]<<8)+(Ca[1])
-	// Ca^LR = (u16)(Ca[2]<<8)+(Ca[3])
-	// Ca^RL = (u16)(Ca[4]<<8)+(Ca[5])
-	// Ca^RR = (u16)(Ca[6]<<8)+(Ca[7])
+// The candidates on <positions>; the other positions keep the bits of base
+static inline KLSet resolveKL(const short table[], u16 Xac, u16 Yac, u16 Xbd, u16 Ybd, u16 positions, u16 base) {
+	KLConstraint r = evaluateKL(table, Xac, Yac, Xbd, Ybd);
+	KLSet s = {base | (r.one & positions), r.free & positions, r.none & positions};
 
-	u16 Xac = ((u16)(Ca[2]<<8)+(Ca[3])) ^ ((u16)(Cc[2]<<8)+(Cc[3]));	// Ca^LR ^ Cc^LR
-	u16 Xbd = ((u16)(Cb[2]<<8)+(Cb[3])) ^ ((u16)(Cd[2]<<8)+(Cd[3]));	// Cb^LR ^ Cd^LR
-	u16 Ya = FI(((u16)(Ca[4]<<8)+(Ca[5])) ^ KO81, KI81);
-	u16 Yb = FI(((u16)(Cb[4]<<8)+(Cb[5])) ^ KO81, KI81);
-	u16 Yc = FI(((u16)(Cc[4]<<8)+(Cc[5])) ^ KO81, KI81);
-	u16 Yd = FI(((u16)(Cd[4]<<8)+(Cd[5])) ^ KO81, KI81);
+	return s;
+}
 
-	u16 Yac = rightRotate(Ya ^ Yc ^ (u16)((Ca[0]<<8)+(Ca[1])) ^ (u16)((Cc[0]<<8)+(Cc[1])), 1);
-	u16 Ybd = rightRotate(Yb ^ Yd ^ (u16)((Cb[0]<<8)+(Cb[1])) ^ (u16)((Cd[0]<<8)+(Cd[1])), 1);
+// KL_BATCH guesses sharing (Xac, Xbd), one per 16-bit lane: none[k] gets the positions
+// without a possible guessing of the k-th (Yac, Ybd). The AVX2 instance does the batch
+// with one 256-bit instruction per operation, the generic one with what the target has.
 
-	Array a;					// will contain all the duplicates of the key KL82 in case we found {0,1} in the lookup table
-	initArray(&a, 4);	
-	int KL82 = 0;
-	insertArray(&a, KL82);
+#define KL_BATCH 16
 
-	// For each bit in (Xac, Yac, Xbd, Ybd) find the corresponding value of the key KL82 through the lookup table
+typedef u16 U16x16 __attribute__((vector_size(2 * KL_BATCH)));
 
-	for (int p = 0; p < 16; p++) {
-		int b;
+typedef struct {
+	U16x16 none, zero, one, free;
+} KLConstraint16;
+
+#define KL_REJECT_16(name, table, target)														\
+target static void name(u16 Xac, const u16 Yac[], u16 Xbd, const u16 Ybd[], u16 none[]) {		\
+	U16x16 xac = (U16x16){0} + Xac, xbd = (U16x16){0} + Xbd, yac, ybd;						\
+	KLConstraint16 r = {{0}, {0}, {0}, {0}};													\
+																								\
+	memcpy(&yac, Yac, sizeof(yac));																\
+	memcpy(&ybd, Ybd, sizeof(ybd));																\
+	KL_EVALUATE(table, U16x16, xac, yac, xbd, ybd, r);											\
+	memcpy(none, &r.none, sizeof(r.none));														\
+}
 
-		if (p > 7 && p < 15) {
-			b = 0;
-		} else {
-			int i = 0;
-			int j = 0;
+KL_REJECT_16(rejectOR16, OR, )
+KL_REJECT_16(rejectAND16, AND, )
 
-			if (Xac & 1) i += 2;	// Current bit is set to 1
-			if (Yac & 1) i += 1;
-			if (Xbd & 1) j += 2;
-			if (Ybd & 1) j += 1;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KL_EVALUATE_X86
 
-			b = OR[4*i + j];
-		}
+KL_REJECT_16(rejectOR16AVX2, OR, __attribute__((target("avx2"))))
+KL_REJECT_16(rejectAND16AVX2, AND, __attribute__((target("avx2"))))
+#endif
 
-		if (b == 3) {
-			freeArray(&a);
-			break;
-		} else if (b == 1) {
-			for (int i = 0; i < a.used; i++) {
-				a.array[i] = a.array[i] + pow(2, p);
-			}
-		} else if (b == 2) {
-			int nKeys = a.used;
-			for (int i = 0; i < nKeys; i++) {
-				int m = a.array[i];			// n -> KL82[p] = 0
-				m = m + pow(2, p);			// m -> KL82[p] = 1
-				insertArray(&a, m);
-			}
-		}
-					
-		Xac >>= 1;
-		Yac >>= 1;
-		Xbd >>= 1;
-		Ybd >>= 1;
+// table is OR or AND
+void rejectKL16(const short table[], u16 Xac, const u16 Yac[], u16 Xbd, const u16 Ybd[], u16 none[]) {
+#ifdef KL_EVALUATE_X86
+	if (__builtin_cpu_supports("avx2")) {
+		(table == OR ? rejectOR16AVX2 : rejectAND16AVX2)(Xac, Yac, Xbd, Ybd, none);
+		return;
 	}
-	
-	return a;	// vettore in cui per tutti i numeri i primi 7 bit sono a 0: ancora non li abbiamo checkati
+#endif
+	(table == OR ? rejectOR16 : rejectAND16)(Xac, Yac, Xbd, Ybd, none);
 }
 
-Array findKL82L(u8 *Ca, u8 *Cb, u8 *Cc, u8 *Cd, u16 KO81, u16 KI81, u16 KL82R) {
+// The candidates in both a and b: a bit is free only if it is free in both, and a bit fixed
+// in both must have the same value
+static inline KLSet intersectKL(KLSet a, KLSet b) {
+	KLSet s = {a.fixed | b.fixed, a.free & b.free, a.empty | b.empty | (~a.free & ~b.free & (a.fixed ^ b.fixed))};
 
-	// Finding input and output differences of the OR operator for bot the coupples of texts
-	// Ca^LL = (u16)(Ca[0]<<8)+(Ca[1])
-	// Ca^LR = (u16)(Ca[2]<<8)+(Ca[3])
-	// Ca^RL = (u16)(Ca[4]<<8)+(Ca[5])
-	// Ca^RR = (u16)(Ca[6]<<8)+(Ca[7])
-
-	u16 Xac = ((u16)(Ca[2]<<8)+(Ca[3])) ^ ((u16)(Cc[2]<<8)+(Cc[3]));	// Ca^LR ^ Cc^LR
-	u16 Xbd = ((u16)(Cb[2]<<8)+(Cb[3])) ^ ((u16)(Cd[2]<<8)+(Cd[3]));	// Cb^LR ^ Cd^LR
-	u16 Ya = FI(((u16)(Ca[4]<<8)+(Ca[5])) ^ KO81, KI81);
-	u16 Yb = FI(((u16)(Cb[4]<<8)+(Cb[5])) ^ KO81, KI81);
-	u16 Yc = FI(((u16)(Cc[4]<<8)+(Cc[5])) ^ KO81, KI81);
-	u16 Yd = FI(((u16)(Cd[4]<<8)+(Cd[5])) ^ KO81, KI81);
-
-	u16 Yac = rightRotate(Ya ^ Yc ^ (u16)((Ca[0]<<8)+(Ca[1])) ^ (u16)((Cc[0]<<8)+(Cc[1])), 1);
-	u16 Ybd = rightRotate(Yb ^ Yd ^ (u16)((Cb[0]<<8)+(Cb[1])) ^ (u16)((Cd[0]<<8)+(Cd[1])), 1);
-
-	Array a;					// will contain all the duplicates of the key KL82 in case we found {0,1} in the lookup table
-	initArray(&a, 4);	
-	int KL82 = KL82R;
-	insertArray(&a, KL82);
+	return s;
+}
 
-	// For each bit in (Xac, Yac, Xbd, Ybd) find the corresponding value of the key KL82 through the lookup table
+// Iterate k over the candidates of s in increasing order (the submasks of free, from 0 on)
+#define KL_FOREACH(s, k) \
+	for (u32 _sub = 0, k = (s).fixed, _more = !(s).empty; _more; \
+	     _sub = (_sub - (s).free) & (s).free, k = (s).fixed | _sub, _more = (_sub != 0))
 
-	for (int p = 0; p < 16; p++) {
-		int b = 0;
+/*------------------------------------- Triple Array ---------------------------------------*/
 
-		if (p > 7 && p < 15) {
-			int i = 0;
-			int j = 0;
+// Doubling array of the (KO, KI, KL) triples suggested by a worker thread
 
-			if (Xac & 1) i += 2;	// Current bit is set to 1
-			if (Yac & 1) i += 1;
-			if (Xbd & 1) j += 2;
-			if (Ybd & 1) j += 1;
+typedef struct {
+	u16 (*triple)[3];
+	size_t used;
+	size_t size;
+} TripleArray;
 
-			b = OR[4*i + j];
-		}
+void initTripleArray(TripleArray *a, size_t initialSize) {
+	a -> triple = malloc(initialSize * sizeof(*(a -> triple)));
+	a -> used = 0;
+	a -> size = initialSize;
+}
 
-		if (b == 3) {
-			freeArray(&a);
-			break;
-		} else if (b == 1) {
-			for (int i = 0; i < a.used; i++) {
-				a.array[i] = a.array[i] + pow(2, p);
-			}
-		} else if (b == 2) {
-			int nKeys = a.used;
-			for (int i = 0; i < nKeys; i++) {
-				int m = a.array[i];			// n -> KL82[p] = 0
-				m = m + pow(2, p);			// m -> KL82[p] = 1
-				insertArray(&a, m);
-			}
-		}
-					
-		Xac >>= 1;
-		Yac >>= 1;
-		Xbd >>= 1;
-		Ybd >>= 1;
+void insertTripleArray(TripleArray *a, u16 KO, u16 KI, u16 KL) {
+	if (a -> used == a -> size) {
+		a -> size *= 2;
+		a -> triple = realloc(a -> triple, a -> size * sizeof(*(a -> triple)));
 	}
-	
-	return a;	// vettore in cui per tutti i numeri i primi 7 bit sono a 0: ancora non li abbiamo checkati
+	a -> triple[a -> used][0] = KO;
+	a -> triple[a -> used][1] = KI;
+	a -> triple[a -> used][2] = KL;
+	a -> used++;
 }
 
-/*--------------------------------------- Find KL81 ----------------------------------------*/
+void freeTripleArray(TripleArray *a) {
+	free(a -> triple);
+	a -> triple = NULL;
+	a -> used = a -> size = 0;
+}
 
-Array findKL81R(u8 *Ca, u8 *Cb, u8 *Cc, u8 *Cd, u16 KO81, u16 KI81, u16 KO83, u16 KI83) {
+/*------------------------------------- Quartet Array --------------------------------------*/
 
-	// Finding input and output differences of the OR operator for bot the coupples of texts
-	// Ca^LL = (u16)(Ca[0]<<8)+(Ca[1])
-	// Ca^LR = (u16)(Ca[2]<<8)+(Ca[3])
-	// Ca^RL = (u16)(Ca[4]<<8)+(Ca[5])
-	// Ca^RR = (u16)(Ca[6]<<8)+(Ca[7])
+// Same growth policy as TripleArray, for the candidate quartets found by a worker thread: each one
+// is its index (C_a^L XOR C_c^L) followed by (C_a, C_b, C_c, C_d)
 
-	u16 X1a = FI(((u16)(Ca[4]<<8)+(Ca[5])) ^ KO81, KI81);		// FI(CaRL ^ KO81, KI81)
-	u16 X1b = FI(((u16)(Cb[4]<<8)+(Cb[5])) ^ KO81, KI81);		
-	u16 X1c = FI(((u16)(Cc[4]<<8)+(Cc[5])) ^ KO81, KI81);		
-	u16 X1d = FI(((u16)(Cd[4]<<8)+(Cd[5])) ^ KO81, KI81);		
+typedef struct {
+	u8 (*quartet)[36];
+	size_t used;
+	size_t size;
+} QuartetArray;
 
-	u16 Xa = FI(X1a ^ ((u16)(Ca[6]<<8)+(Ca[7])) ^ KO83, KI83) ^ X1a;				// FI(X1a ^ CaRR ^ KO83, KI83) ^ X1a	
-	u16 Xb = FI(X1b ^ ((u16)(Cb[6]<<8)+(Cb[7])) ^ KO83, KI83) ^ X1b;	
-	u16 Xc = FI(X1c ^ ((u16)(Cc[6]<<8)+(Cc[7])) ^ KO83, KI83 ^ 0x8000) ^ X1c;	
-	u16 Xd = FI(X1d ^ ((u16)(Cd[6]<<8)+(Cd[7])) ^ KO83, KI83 ^ 0x8000) ^ X1d;	
+void initQuartetArray(QuartetArray *a, size_t initialSize) {
+	a -> quartet = malloc(initialSize * sizeof(*(a -> quartet)));
+	a -> used = 0;
+	a -> size = initialSize;
+}
 
-	u16 Yac = rightRotate(Xa ^ Xc ^ ((u16)(Ca[2]<<8)+(Ca[3])) ^ ((u16)(Cc[2]<<8)+(Cc[3])), 1);	//(Xa ^ Xc ^ CaLR ^ CcLR) >>> 1
-	u16 Ybd = rightRotate(Xb ^ Xd ^ ((u16)(Cb[2]<<8)+(Cb[3])) ^ ((u16)(Cd[2]<<8)+(Cd[3])), 1);
+void insertQuartetArray(QuartetArray *a, u8 index[], u8 CaCb[], u8 CcCd[]) {
+	if (a -> used == a -> size) {
+		a -> size *= 2;
+		a -> quartet = realloc(a -> quartet, a -> size * sizeof(*(a -> quartet)));
+	}
+	memcpy(a -> quartet[a -> used], index, 4);
+	memcpy(a -> quartet[a -> used] + 4, CaCb, 16);
+	memcpy(a -> quartet[a -> used] + 20, CcCd, 16);
+	a -> used++;
+}
 
-	u16 Xac = X1a ^ X1c;
-	u16 Xbd = X1b ^ X1d;
+void freeQuartetArray(QuartetArray *a) {
+	free(a -> quartet);
+	a -> quartet = NULL;
+	a -> used = a -> size = 0;
+}
 
-	Array a;					// will contain all the duplicates of the key KL81 in case we found {0,1} in the lookup table
-	initArray(&a, 4);	
-	int KL81 = 0;
-	insertArray(&a, KL81);
+/*------------------------------------- Quartet Batches ------------------------------------*/
 
-	// For each bit in (Xac, Yac, Xbd, Ybd) find the corresponding value of the key KL82 through the lookup table
+// Phase 1 hands its candidate quartets to phase 2 in numbered batches, on a bounded queue
+// (Pipeline.c): phase 2 starts collecting them while phase 1(b) is still running.
 
-	for (int p = 0; p < 16; p++) {
-		int b;
+#define QUARTET_BATCH 4096		// quartets per batch of the sort-merge join and of a -q file
+#define QUARTET_QUEUE 64		// batches waiting on the queue at most
 
-		if (p > 7 && p < 15) {
-			b = 0;
-		} else {
-			int i = 0;
-			int j = 0;
+struct quartetBatch {
+	size_t seq;									// phase 2 takes the batches in seq order
+	QuartetArray quartets;						// found by phase 1, or
+	const struct rightQuartetsEntry *saved;		// read in place from a -q file
+	size_t nSaved;
+};
 
-			if (Xac & 1) i += 2;	// Current bit is set to 1
-			if (Yac & 1) i += 1;
-			if (Xbd & 1) j += 2;
-			if (Ybd & 1) j += 1;
+// The batch takes over the array of quartets
+void pushQuartetBatch(BoundedQueue *q, size_t seq, QuartetArray *quartets, const struct rightQuartetsEntry *saved, size_t nSaved) {
+	struct quartetBatch *b = calloc(1, sizeof(struct quartetBatch));
 
-			//printf("p: %d\t", 4*i + j);
+	b -> seq = seq;
+	if (quartets) b -> quartets = *quartets;
+	b -> saved = saved;
+	b -> nSaved = nSaved;
+	pushBoundedQueue(q, b);
+}
 
-			b = AND[4*i + j];
+// Give the quartets of a batch to the filter of phase 2 (see collectRightQuartet()) and free it
+void collectQuartetBatch(struct quartetBatch *b, RightQuartetsTable *t) {
+	u8 index[4];
+
+	for (size_t i = 0; i < b -> quartets.used; i++) {
+		u8 *q = b -> quartets.quartet[i];
+		collectRightQuartet(t, q, q + 4, q + 12, q + 20, q + 28);
+	}
+
+	for (size_t i = 0; i < b -> nSaved; i++) {
+		u8 *q = (u8 *)b -> saved[i].CaCbCcCd;
+
+		rightQuartetIndex(&(b -> saved[i]), index);
+		collectRightQuartet(t, index, q, q + 8, q + 16, q + 24);
+	}
+
+	freeQuartetArray(&(b -> quartets));
+	free(b);
+}
+
+// Output of the sort-merge join: the quartets in batches of QUARTET_BATCH
+struct joinOutput {
+	BoundedQueue *queue;
+	size_t seq;
+	QuartetArray batch;
+};
+
+void emitJoinedQuartet(u8 index[], u8 CaCb[], u8 CcCd[], void *arg) {
+	struct joinOutput *out = arg;
+
+	insertQuartetArray(&(out -> batch), index, CaCb, CcCd);
+
+	if (out -> batch.used == QUARTET_BATCH) {
+		pushQuartetBatch(out -> queue, out -> seq++, &(out -> batch), NULL, 0);
+		initQuartetArray(&(out -> batch), QUARTET_BATCH);
+	}
+}
+
+/*------------------------------- Parallel Data Collection ---------------------------------*/
+
+// Each structure is generated ORACLE_BATCH ciphertexts per chunk. The X (Y) value of the j-th
+// ciphertext is permute32(key, j), a keyed permutation of the 32-bit values: the 2^24 values
+// of a structure are all different, any thread computes element j on its own, and the data
+// depend only on the seed, not on the number of threads. The expanded keys are only read
+// and are shared by all the threads.
+
+#define STRUCTURE_A 0xffffffffULL		// right half A of C_a; C_c^R = A xor 0010 0000_x
+
+// SplitMix64: the seed sequence, and mix64() its output function as a hash
+static u64 mix64(u64 z) {
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static u64 nextRandom(u64 *state) {
+	return mix64(*state += 0x9e3779b97f4a7c15ULL);
+}
+
+// Four-round Feistel network on the 16-bit halves of x, the round functions taken from mix64()
+static u32 permute32(u64 key, u32 x) {
+	u16 l = x >> 16, r = x & 0xffff;
+
+	for (u64 i = 0; i < 4; i++) {
+		u16 f = (u16)mix64(key ^ (i << 16) ^ r);
+		u16 t = l ^ f;
+		l = r;
+		r = t;
+	}
+
+	return ((u32)l << 16) | r;
+}
+
+struct oracleJob {
+	int n;								// ciphertexts in the structure
+	u64 seed;							// key of the permutation of the X (Y) values
+	struct joinRecord *records;			// (a): the pairs (C_a, C_b), (b) with -j sort: the pairs (C_c, C_d)
+	size_t (*partition)[DC_PARTITIONS + 1];	// (a): where each partition starts in the records of a chunk
+	BoundedQueue *out;					// (b) with -j hash: the candidate quartets, one batch per chunk
+};
+
+// Fill batchC with the chunk's ciphertexts of structure (a) (C_a = (X, A)) or (b)
+// (C_c = (Y, A xor 0010 0000_x)) and batchP with the other ciphertext of their pairs:
+// decrypt under K_a (K_c), xor (0_x, 0010 0000_x), encrypt under K_b (K_d)
+static int oracleBatch(struct oracleJob *job, int chunk, int structure, u64 *batchC, u64 *batchP) {
+	int j0 = chunk * ORACLE_BATCH;
+	int nBatch = (job -> n - j0 < ORACLE_BATCH) ? job -> n - j0 : ORACLE_BATCH;
+	u64 right = structure ? STRUCTURE_A ^ 0x00100000 : STRUCTURE_A;
+
+	if (savedStructures) {
+		const u64 (*saved)[2] = savedStructures + (size_t)structure * job -> n + j0;
+
+		for (int t = 0; t < nBatch; t++) {
+			batchC[t] = saved[t][0];
+			batchP[t] = saved[t][1];
 		}
+		return nBatch;
+	}
 
-		//printf("b: %d\n", b);
+	for (int t = 0; t < nBatch; t++) {
+		batchC[t] = ((u64)permute32(job -> seed, j0 + t) << 32) | right;
+	}
 
-		if (b == 3) {
-			freeArray(&a);
-			break;
-		} else if (b == 1) {
-			for (int i = 0; i < a.used; i++) {
-				a.array[i] = a.array[i] + pow(2, p);
-			}
-		} else if (b == 2) {
-			int nKeys = a.used;
-			for (int i = 0; i < nKeys; i++) {
-				int m = a.array[i];			// n -> KL81[p] = 0
-				m = m + pow(2, p);			// m -> KL81[p] = 1
-				insertArray(&a, m);
+	memcpy(batchP, batchC, nBatch*sizeof(*batchC));
+#if USE_BITSLICE
+	KasumiBitsliceDecrypt(structure ? Kc : Ka, batchP, nBatch);
+#else
+	KasumiDecryptBlocksFI(structure ? &fkC : &fkA, batchP, nBatch);
+#endif
+
+	for (int t = 0; t < nBatch; t++) {
+		batchP[t] ^= 0x00100000;
+	}
+
+#if USE_BITSLICE
+	KasumiBitsliceEncrypt(structure ? Kd : Kb, batchP, nBatch);
+#else
+	KasumiEncryptBlocksFI(structure ? &fkD : &fkB, batchP, nBatch);
+#endif
+
+	if (savingStructures) {
+		u64 records[ORACLE_BATCH][2];
+
+		for (int t = 0; t < nBatch; t++) {
+			records[t][0] = batchC[t];
+			records[t][1] = batchP[t];
+		}
+		if (writeDatasetRecords(&structuresWriter, (u64)structure * job -> n + j0, records, nBatch) != 0)
+			savingStructures = 0;
+	}
+
+	return nBatch;
+}
+
+// Structure (a): the pairs (C_a, C_b) of the chunk, grouped by partition of C_b^R. The
+// grouping is stable, so inside a partition the pairs keep the order of the serial loop.
+void oracleABChunk(void *arg, int chunk, int thread) {
+	struct oracleJob *job = arg;
+	u64 batchC[ORACLE_BATCH], batchP[ORACLE_BATCH];
+	int j0 = chunk * ORACLE_BATCH;
+	int nBatch = oracleBatch(job, chunk, 0, batchC, batchP);
+	size_t *start = job -> partition[chunk];
+	size_t next[DC_PARTITIONS];
+
+	memset(start, 0, (DC_PARTITIONS + 1) * sizeof(*start));
+	for (int t = 0; t < nBatch; t++) {
+		start[DC_PARTITION((u32)batchP[t]) + 1]++;
+	}
+	for (int p = 0; p < DC_PARTITIONS; p++) {
+		start[p + 1] += start[p];
+		next[p] = start[p];
+	}
+
+	for (int t = 0; t < nBatch; t++) {
+		u32 key = (u32)batchP[t];
+		struct joinRecord *r = &(job -> records[j0 + next[DC_PARTITION(key)]++]);
+
+		r -> key = key;
+		r -> seq = j0 + t;
+		BlockToBytes(batchC[t], r -> pair);
+		BlockToBytes(batchP[t], r -> pair + 8);
+	}
+}
+
+// Build partition p of the hash table from the pairs of all the chunks, in chunk order
+void insertPartitionChunk(void *arg, int p, int thread) {
+	struct oracleJob *job = arg;
+	int nChunks = (job -> n + ORACLE_BATCH - 1) / ORACLE_BATCH;
+	size_t count = 0;
+
+	for (int c = 0; c < nChunks; c++) {
+		count += job -> partition[c][p + 1] - job -> partition[c][p];
+	}
+
+	initFlatHash(&dataCollectionTable[p], count);
+
+	for (int c = 0; c < nChunks; c++) {
+		struct joinRecord *r = &(job -> records[(size_t)c * ORACLE_BATCH]);
+
+		for (size_t i = job -> partition[c][p]; i < job -> partition[c][p + 1]; i++) {
+			addFlatHash(&dataCollectionTable[p], r[i].key, r[i].pair);
+		}
+	}
+}
+
+// Structure (b): with -j hash probe the table for every (C_c, C_d) of the chunk and push the
+// candidate quartets to phase 2; with -j sort only store the pairs, joined afterwards
+void oracleCDChunk(void *arg, int chunk, int thread) {
+	struct oracleJob *job = arg;
+	u64 batchC[ORACLE_BATCH], batchP[ORACLE_BATCH];
+	int j0 = chunk * ORACLE_BATCH;
+	int nBatch = oracleBatch(job, chunk, 1, batchC, batchP);
+	QuartetArray quartets;
+
+	if (joinEngine == JOIN_HASH)
+		initQuartetArray(&quartets, 16);
+
+	for (int t = 0; t < nBatch; t++) {
+		u32 key = (u32)batchP[t] ^ 0x00100000;		// C_d^R xor 0010 0000_x
+		u8 CcCd[16], *CaCb, index[4];
+		size_t cursor = 0;
+
+		BlockToBytes(batchC[t], CcCd);
+		BlockToBytes(batchP[t], CcCd + 8);
+
+		if (joinEngine == JOIN_SORT) {
+			struct joinRecord *r = &(job -> records[j0 + t]);
+			r -> key = key;
+			r -> seq = j0 + t;
+			memcpy(r -> pair, CcCd, 16);
+			continue;
+		}
+
+		while ((CaCb = findDataCollectionEntry(key, &cursor)) != NULL) {
+			for (int i = 0; i < 4; i++) {
+				index[i] = CaCb[i] ^ CcCd[i];		// C_a^L XOR C_c^L
 			}
+			insertQuartetArray(&quartets, index, CaCb, CcCd);
 		}
-					
-		Xac >>= 1;
-		Yac >>= 1;
-		Xbd >>= 1;
-		Ybd >>= 1;
 	}
 
-	//printf("\n");
+	if (joinEngine == JOIN_HASH)
+		pushQuartetBatch(job -> out, chunk, &quartets, NULL, 0);
+}
 
-	return a;
+/*--------------------------------------- Find KL82 ----------------------------------------*/
+
+// The KL82^R candidates given by the input (Xac, Xbd) and output (Yac, Ybd) differences of
+// the OR operator in the two pairs
+KLSet resolveKL82R(u16 Xac, u16 Yac, u16 Xbd, u16 Ybd) {
+	return resolveKL(OR, Xac, Yac, Xbd, Ybd, KL_R, 0);
 }
 
+KLSet findKL82R(const Quartet *x, u16 KO81, u16 KI81) {
+
+	// Finding input and output differences of the OR operator for bot the coupples of texts
+
+	u16 Xac = x -> LR[QA] ^ x -> LR[QC];	// Ca^LR ^ Cc^LR
+	u16 Xbd = x -> LR[QB] ^ x -> LR[QD];	// Cb^LR ^ Cd^LR
+	u16 Ya = KasumiFI(x -> RL[QA] ^ KO81, KI81);
+	u16 Yb = KasumiFI(x -> RL[QB] ^ KO81, KI81);
+	u16 Yc = KasumiFI(x -> RL[QC] ^ KO81, KI81);
+	u16 Yd = KasumiFI(x -> RL[QD] ^ KO81, KI81);
 
-Array findKL81L(u8 *Ca, u8 *Cb, u8 *Cc, u8 *Cd, u16 KO81, u16 KI81, u16 KO83, u16 KI83, u16 KL81R) {
+	u16 Yac = rightRotate(Ya ^ Yc ^ x -> LL[QA] ^ x -> LL[QC], 1);
+	u16 Ybd = rightRotate(Yb ^ Yd ^ x -> LL[QB] ^ x -> LL[QD], 1);
+
+	return resolveKL82R(Xac, Yac, Xbd, Ybd);
+}
+
+KLSet findKL82L(const Quartet *x, u16 KO81, u16 KI81, u16 KL82R) {
 
 	// Finding input and output differences of the OR operator for bot the coupples of texts
-	// Ca^LL = (u16)(Ca[0]<<8)+(Ca[1])
-	// Ca^LR = (u16)(Ca[2]<<8)+(Ca[3])
-	// Ca^RL = (u16)(Ca[4]<<8)+(Ca[5])
-	// Ca^RR = (u16)(Ca[6]<<8)+(Ca[7])
 
-	u16 X1a = FI(((u16)(Ca[4]<<8)+(Ca[5])) ^ KO81, KI81);		// FI(CaRL ^ KO81, KI81)
-	u16 X1b = FI(((u16)(Cb[4]<<8)+(Cb[5])) ^ KO81, KI81);		
-	u16 X1c = FI(((u16)(Cc[4]<<8)+(Cc[5])) ^ KO81, KI81);		
-	u16 X1d = FI(((u16)(Cd[4]<<8)+(Cd[5])) ^ KO81, KI81);		
+	u16 Xac = x -> LR[QA] ^ x -> LR[QC];	// Ca^LR ^ Cc^LR
+	u16 Xbd = x -> LR[QB] ^ x -> LR[QD];	// Cb^LR ^ Cd^LR
+	u16 Ya = KasumiFI(x -> RL[QA] ^ KO81, KI81);
+	u16 Yb = KasumiFI(x -> RL[QB] ^ KO81, KI81);
+	u16 Yc = KasumiFI(x -> RL[QC] ^ KO81, KI81);
+	u16 Yd = KasumiFI(x -> RL[QD] ^ KO81, KI81);
+
+	u16 Yac = rightRotate(Ya ^ Yc ^ x -> LL[QA] ^ x -> LL[QC], 1);
+	u16 Ybd = rightRotate(Yb ^ Yd ^ x -> LL[QB] ^ x -> LL[QD], 1);
 
-	u16 Xa = FI(X1a ^ ((u16)(Ca[6]<<8)+(Ca[7])) ^ KO83, KI83) ^ X1a;				// FI(X1a ^ CaRR ^ KO83, KI83) ^ X1a	
-	u16 Xb = FI(X1b ^ ((u16)(Cb[6]<<8)+(Cb[7])) ^ KO83, KI83) ^ X1b;	
-	u16 Xc = FI(X1c ^ ((u16)(Cc[6]<<8)+(Cc[7])) ^ KO83, KI83 ^ 0x8000) ^ X1c;	
-	u16 Xd = FI(X1d ^ ((u16)(Cd[6]<<8)+(Cd[7])) ^ KO83, KI83 ^ 0x8000) ^ X1d;	
+	return resolveKL(OR, Xac, Yac, Xbd, Ybd, KL_L, KL82R);
+}
 
-	u16 Yac = rightRotate(Xa ^ Xc ^ ((u16)(Ca[2]<<8)+(Ca[3])) ^ ((u16)(Cc[2]<<8)+(Cc[3])), 1);	//(Xa ^ Xc ^ CaLR ^ CcLR) >>> 1
-	u16 Ybd = rightRotate(Xb ^ Xd ^ ((u16)(Cb[2]<<8)+(Cb[3])) ^ ((u16)(Cd[2]<<8)+(Cd[3])), 1);
+/*----------------------------------- Parallel KL82^R --------------------------------------*/
 
-	u16 Xac = X1a ^ X1c;
-	u16 Xbd = X1b ^ X1d;
+#define KO_CHUNKS 256		// chunks of the 2^16 KO values given to the worker threads
+#define KO_PER_CHUNK (0x10000 / KO_CHUNKS)
+#define KI_R 0x200			// values of KI81^R, the 9 bits of KI81 guessed in phase 3(a)
 
-	Array a;					// will contain all the duplicates of the key KL81 in case we found {0,1} in the lookup table
-	initArray(&a, 4);	
-	int KL81 = KL81R;
-	insertArray(&a, KL81);
+// FI(v, KI81^R) for every input v and every KI81^R (64 MB). It does not depend on the quartet:
+// built once, it turns the four FI calls of each (KO81, KI81^R) guess into lookups.
 
-	// For each bit in (Xac, Yac, Xbd, Ybd) find the corresponding value of the key KL82 through the lookup table
+u16 (*fiTable)[0x10000] = NULL;
 
-	for (int p = 0; p < 16; p++) {
-		int b = 0;
+void fiTableChunk(void *arg, int ki, int thread) {
+	FITable(fiTable[ki], ki);
+}
 
-		if (p > 7 && p < 15) {
-			int i = 0;
-			int j = 0;
+void buildFITable(void) {
+	fiTable = malloc(KI_R * sizeof(*fiTable));
+	parallelFor(KI_R, fiTableChunk, NULL, NULL);
+}
 
-			if (Xac & 1) i += 2;	// Current bit is set to 1
-			if (Yac & 1) i += 1;
-			if (Xbd & 1) j += 2;
-			if (Ybd & 1) j += 1;
+void freeFITable(void) {
+	free(fiTable);
+	fiTable = NULL;
+}
 
-			//printf("p: %d\t", 4*i + j);
+// The guesses go through a pipeline of filters, cheapest first, each one only seeing the
+// survivors of the previous one:
+//   1. pair (a, c): row Xac_p = 0, Yac_p = 1 of the OR table is all 3, whatever the pair (b, d).
+//      Only the two FI lookups of Yac are needed to reject the guess.
+//   2. pair (b, d): the same for the column Xbd_p = 0, Ybd_p = 1 and the two lookups of Ybd.
+//   3. OR table: the joint bitwise evaluator on both pairs, KL_BATCH guesses at a time.
+//   4. resolveKL82R, enumerating the triples of the guesses left.
+enum {STAGE_AC, STAGE_BD, STAGE_OR, STAGE_TRIPLES, KL82_STAGES};
+
+#define OR_REJECT_PAIR(X, Y) ((~(X) & (Y) & KL_R) != 0)
+
+struct guessKL82RJob {
+	const Quartet *x;				// the quartet under analysis
+	TripleArray *suggested;			// one list of (KO81, KI81^R, KL82^R) per chunk
+	u64 (*passed)[KL82_STAGES];		// guesses passing each stage, per chunk
+};
 
-			b = AND[4*i + j];
+// Guess every (KO81, KI81^R) with KO81 in chunk <chunk> and collect the suggested triples.
+//
+// Xac and Xbd do not depend on the guess: the whole KO81 chunk is run under one KI81^R through
+// the filter stages, the survivors of each one compacted in front of the arrays. The guesses
+// left are marked in a bitmap and go through resolveKL82R in (KO81, KI81^R) order, as in the
+// serial loop.
+void guessKL82RChunk(void *arg, int chunk, int thread) {
+	struct guessKL82RJob *job = arg;
+	const Quartet *x = job -> x;
+	TripleArray *suggested = &(job -> suggested[chunk]);
+	u64 *passed = job -> passed[chunk];
+	int ko0 = chunk * KO_PER_CHUNK;
+
+	u16 Xac = x -> LR[QA] ^ x -> LR[QC];
+	u16 Xbd = x -> LR[QB] ^ x -> LR[QD];
+	u16 LLac = x -> LL[QA] ^ x -> LL[QC];
+	u16 LLbd = x -> LL[QB] ^ x -> LL[QD];
+	u16 Yac[KO_PER_CHUNK], Ybd[KO_PER_CHUNK], none[KO_PER_CHUNK];
+	u8 k[KO_PER_CHUNK];
+	u64 survivors[KO_PER_CHUNK][KI_R / 64] = {{0}};
+
+	initTripleArray(suggested, 1024);
+	memset(passed, 0, KL82_STAGES * sizeof(u64));
+
+	for (int ki = 0; ki < KI_R; ki++) {
+		const u16 *T = fiTable[ki];
+		int n = 0, m = 0;
+
+		for (int i = 0; i < KO_PER_CHUNK; i++) {
+			u16 ko = ko0 + i;
+			u16 yac = T[x -> RL[QA] ^ ko] ^ T[x -> RL[QC] ^ ko] ^ LLac;
+
+			k[n] = i;
+			Yac[n] = rightRotate(yac, 1);
+			n += !OR_REJECT_PAIR(Xac, Yac[n]);
 		}
+		passed[STAGE_AC] += n;
 
-		//printf("b: %d\n", b);
+		for (int i = 0; i < n; i++) {
+			u16 ko = ko0 + k[i];
+			u16 ybd = T[x -> RL[QB] ^ ko] ^ T[x -> RL[QD] ^ ko] ^ LLbd;
 
-		if (b == 3) {
-			freeArray(&a);
-			break;
-		} else if (b == 1) {
-			for (int i = 0; i < a.used; i++) {
-				a.array[i] = a.array[i] + pow(2, p);
-			}
-		} else if (b == 2) {
-			int nKeys = a.used;
-			for (int i = 0; i < nKeys; i++) {
-				int m = a.array[i];			// n -> KL81[p] = 0
-				m = m + pow(2, p);			// m -> KL81[p] = 1
-				insertArray(&a, m);
-			}
+			k[m] = k[i];
+			Yac[m] = Yac[i];
+			Ybd[m] = rightRotate(ybd, 1);
+			m += !OR_REJECT_PAIR(Xbd, Ybd[m]);
+		}
+		passed[STAGE_BD] += m;
+
+		for (int i = m; i % KL_BATCH; i++) {
+			Yac[i] = Ybd[i] = 0;
+		}
+		for (int i = 0; i < m; i += KL_BATCH) {
+			rejectKL16(OR, Xac, Yac + i, Xbd, Ybd + i, none + i);
+		}
+
+		for (int i = 0; i < m; i++) {
+			int ok = (none[i] & KL_R) == 0;
+
+			survivors[k[i]][ki / 64] |= (u64)ok << (ki % 64);
+			passed[STAGE_OR] += ok;
 		}
-					
-		Xac >>= 1;
-		Yac >>= 1;
-		Xbd >>= 1;
-		Ybd >>= 1;
 	}
 
-	//printf("\n");
+	for (int i = 0; i < KO_PER_CHUNK; i++) {
+		u16 ko = ko0 + i;
 
-	return a;
+		for (int w = 0; w < KI_R / 64; w++) {
+			for (u64 m = survivors[i][w]; m; m &= m - 1) {
+				int ki = 64 * w + __builtin_ctzll(m);
+				const u16 *T = fiTable[ki];
+				u16 yac = T[x -> RL[QA] ^ ko] ^ T[x -> RL[QC] ^ ko] ^ LLac;
+				u16 ybd = T[x -> RL[QB] ^ ko] ^ T[x -> RL[QD] ^ ko] ^ LLbd;
+				KLSet s = resolveKL82R(Xac, rightRotate(yac, 1), Xbd, rightRotate(ybd, 1));
+
+				KL_FOREACH(s, kl) {
+					insertTripleArray(suggested, ko, ki, kl);
+				}
+			}
+		}
+	}
+	passed[STAGE_TRIPLES] = suggested -> used;
 }
 
-/*--------------------------------------- SANDWICH -----------------------------------------*/
+// Sum the per chunk counters and print the survival rate of each stage over its own input
+void printKL82RStages(u64 (*passed)[KL82_STAGES]) {
+	u64 total[KL82_STAGES] = {0};
+	double guesses = (double)0x10000 * KI_R;
 
-int main(void) {
-	clock_t begin = clock();
-	time_t t;
-	int exp = 24;
-	int nPlaintext = pow(2, exp);       // should be pow(2, 24)
-	srand((unsigned) time(&t));    		// Initializes random number generator
-	int z = 0;                     		// Initializes the progress bar
+	for (int c = 0; c < KO_CHUNKS; c++) {
+		for (int s = 0; s < KL82_STAGES; s++) {
+			total[s] += passed[c][s];
+		}
+	}
 
-	//int realRightQuartets = 0;
-	//int rightQuartets = 0;
+	printf("KL82^R filter stages: pair (a, c) %.3f%%, pair (b, d) %.3f%%, OR table %.3f%% -> %llu guesses, %llu triples\n",
+		100.0 * total[STAGE_AC] / guesses,
+		total[STAGE_AC] ? 100.0 * total[STAGE_BD] / total[STAGE_AC] : 0.0,
+		total[STAGE_BD] ? 100.0 * total[STAGE_OR] / total[STAGE_BD] : 0.0,
+		(unsigned long long)total[STAGE_OR], (unsigned long long)total[STAGE_TRIPLES]);
+}
 
-	//int nRightQuartets[30];
-	//for (int i = 0; i < 30; i++) {
-	//	nRightQuartets[i] = 0;
-	//}
+/*--------------------------------------- Find KL81 ----------------------------------------*/
 
-	//for (int w = 0; w < 1000; w++) {
+// A quartet once (KO81, KI81) is guessed: the first FI of FO8 is known for the four texts,
+// only the part depending on (KO83, KI83) is left to each guess
 
-	// Hardcoded key Ka
-	
-	Ka = (u8 [16]) {
-		0x99, 0x00, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF,
-		0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 
-	};
-	
-	
-	/*
-	for (int i = 0; i < 16; i++) {
-		Ka[i] = rand() % 255;     // 255_10 = ff_16 = 11111111_2
+typedef struct {
+	u16 X1[4];				// FI(C^RL ^ KO81, KI81) of (C_a, C_b, C_c, C_d)
+	u16 RR[4];				// C^RR
+	u16 LRac, LRbd;			// Ca^LR ^ Cc^LR, Cb^LR ^ Cd^LR
+} Quartet81;
+
+void prepareQuartet81(const Quartet *x, u16 KO81, u16 KI81, Quartet81 *y) {
+	for (int t = QA; t <= QD; t++) {
+		y -> X1[t] = KasumiFI(x -> RL[t] ^ KO81, KI81);		// FI(CaRL ^ KO81, KI81)
+		y -> RR[t] = x -> RR[t];
 	}
-	*/
-	
-	generateRelatedKeys(Ka);
 
-	printHex("Ka", Ka, 16);
-	printHex("Kb", Kb, 16);
-	printHex("Kc", Kc, 16);
-	printHex("Kd", Kd, 16);
+	y -> LRac = x -> LR[QA] ^ x -> LR[QC];
+	y -> LRbd = x -> LR[QB] ^ x -> LR[QD];
+}
 
-	/*-------------------------------------------------------------------------------------------
-	 * 1. Data Collection Phase:
-	 *-------------------------------------------------------------------------------------------*/
+// Finding input and output differences of the AND operator for both the couples of texts
+static inline KLSet resolveKL81(const Quartet81 *y, u16 KO83, u16 KI83, u16 positions, u16 base) {
+	const u16 *X1 = y -> X1;
 
-	/*-------------------------------------------------------------------------------------------
-	 *	(a) Choose a structure of 2^24 ciphertexts of the form C_a = (X_a, A), where
-	 *		A is ﬁxed and X a assumes 2^24 arbitrary diﬀerent values. 
-	 *-------------------------------------------------------------------------------------------*/
+	u16 Xa = KasumiFI(X1[QA] ^ y -> RR[QA] ^ KO83, KI83) ^ X1[QA];				// FI(X1a ^ CaRR ^ KO83, KI83) ^ X1a
+	u16 Xb = KasumiFI(X1[QB] ^ y -> RR[QB] ^ KO83, KI83) ^ X1[QB];
+	u16 Xc = KasumiFI(X1[QC] ^ y -> RR[QC] ^ KO83, KI83 ^ 0x8000) ^ X1[QC];
+	u16 Xd = KasumiFI(X1[QD] ^ y -> RR[QD] ^ KO83, KI83 ^ 0x8000) ^ X1[QD];
 
-	u8 Pa[8], Pb[8], Pc[8], Pd[8], Ca[8], Cb[8], Cc[8], Cd[8];
-	u8 indexDC[4], indexRQ[4];
-	u8 A[4] = {
-		0xff, 0xff, 0xff, 0xff,
-	};
+	u16 Yac = rightRotate(Xa ^ Xc ^ y -> LRac, 1);	//(Xa ^ Xc ^ CaLR ^ CcLR) >>> 1
+	u16 Ybd = rightRotate(Xb ^ Xd ^ y -> LRbd, 1);
 
-	printf("PHASE 1: DATA COLLECTION\n");
-	printf("Generating Ca, Pa, Pb and Cb...\n");
+	u16 Xac = X1[QA] ^ X1[QC];
+	u16 Xbd = X1[QB] ^ X1[QD];
+
+	return resolveKL(AND, Xac, Yac, Xbd, Ybd, positions, base);
+}
 
-	for (int j = 0; j < nPlaintext; j++) {
+KLSet findKL81R(const Quartet *x, u16 KO81, u16 KI81, u16 KO83, u16 KI83) {
+	Quartet81 y;
 
-		for (int i = 0; i < 4; i++) {
-			Ca[i] = rand() % 255;     // 255_10 = ff_16 = 11111111_2
-		}
-		for (int i = 0; i < 4; i++) {
-			Ca[4+i] = A[i];
+	prepareQuartet81(x, KO81, KI81, &y);
+	return resolveKL81(&y, KO83, KI83, KL_R, 0);
+}
+
+KLSet findKL81L(const Quartet *x, u16 KO81, u16 KI81, u16 KO83, u16 KI83, u16 KL81R) {
+	Quartet81 y;
+
+	prepareQuartet81(x, KO81, KI81, &y);
+	return resolveKL81(&y, KO83, KI83, KL_L, KL81R);
+}
+
+/*----------------------------------- Parallel KL81^R --------------------------------------*/
+
+// Phase 3(b) guesses (KO83, KI83^R) for every candidate (KO81, KI81): chunk c covers the KO83
+// range c % KO_CHUNKS of the candidate c / KO_CHUNKS. The pool hands the chunks out one at a
+// time, so idle threads keep taking work from whichever candidate still has some, and each
+// chunk writes its own list: merging them in chunk order gives the same sets on any number
+// of threads. The chunks left of each candidate are counted: once the candidates up to one
+// are all swept, their lists go to run -> swept and to the checkpoint.
+//
+// All the right quartets are tested in the same sweep: a guess is kept with the KL81^R
+// candidates common to every quartet, and dropped as soon as one quartet leaves none, so
+// most guesses cost one quartet instead of all of them.
+
+struct guessKL81RJob {
+	u16 (*candidate)[2];				// the distinct (KO81, KI81) of OrSet
+	int nCandidates;
+	int first;							// chunk 0 of the pool is the first of this candidate
+	const Quartet *quartets;			// the right quartets, decoded
+	int nQuartets;
+	TripleArray *suggested;				// one list of (KO83, KI83^R, KL81^R) per chunk
+	int *chunksLeft;					// per candidate
+	int nSwept;							// candidates swept, all of those before too
+	pthread_mutex_t lock;
+	struct attackRun *run;
+};
+
+// Called by the chunk that ends the sweep of a candidate
+static void sweptKL81RCandidate(struct guessKL81RJob *job) {
+	struct attackRun *run = job -> run;
+
+	pthread_mutex_lock(&(job -> lock));
+
+	for (; job -> nSwept < job -> nCandidates && __atomic_load_n(&(job -> chunksLeft[job -> nSwept]), __ATOMIC_ACQUIRE) == 0; job -> nSwept++) {
+		TripleArray *chunks = job -> suggested + (size_t)job -> nSwept * KO_CHUNKS;
+
+		for (int c = 0; c < KO_CHUNKS; c++) {
+			for (size_t i = 0; i < chunks[c].used; i++) {
+				if (run -> nSwept == run -> sizeSwept) {
+					run -> sizeSwept = run -> sizeSwept ? 2 * run -> sizeSwept : 1024;
+					run -> swept = realloc(run -> swept, run -> sizeSwept * sizeof(u16[4]));
+				}
+				run -> swept[run -> nSwept][0] = job -> nSwept;
+				memcpy(&(run -> swept[run -> nSwept][1]), chunks[c].triple[i], sizeof(u16[3]));
+				run -> nSwept++;
+			}
 		}
+	}
 
-		//printHex("Ca", Ca, 8);
+	saveCheckpoint(run, STAGE_3B, job -> nSwept, 0, 0);
+	pthread_mutex_unlock(&(job -> lock));
+}
 
-		/*-------------------------------------------------------------------------------------------
-		 *		Ask for the decryption of all the ciphertexts under the key K_a and denote the plain-
-		 * 		text corresponding to C_a by P_a.
-		 *-------------------------------------------------------------------------------------------*/
+void guessKL81RChunk(void *arg, int chunk, int thread) {
+	struct guessKL81RJob *job = arg;
+	int g = job -> first + chunk / KO_CHUNKS;
+	TripleArray *suggested = &(job -> suggested[(size_t)job -> first * KO_CHUNKS + chunk]);
+	u16 KO81 = job -> candidate[g][0];
+	u16 KI81 = job -> candidate[g][1];
+	int ko0 = (chunk % KO_CHUNKS) * KO_PER_CHUNK;
+	int nQuartets = job -> nQuartets;
+	Quartet81 *y = malloc(nQuartets * sizeof(Quartet81));
+
+	for (int n = 0; n < nQuartets; n++) {
+		prepareQuartet81(&(job -> quartets[n]), KO81, KI81, &y[n]);
+	}
 
-		memcpy(Pa, &Ca[0], 8*sizeof(*Ca));
-		KeySchedule(Ka);
-		KasumiDecipher(Pa);
+	initTripleArray(suggested, 256);
 
-		//printHex("Pa", Pa, 8);
+	for (int ko = ko0; ko < ko0 + KO_PER_CHUNK; ko++) {
+		for (int ki = 0; ki <= 0x01ff; ki++) {
+			KLSet s = resolveKL81(&y[0], ko, ki, KL_R, 0);
 
-		/*-------------------------------------------------------------------------------------------
-		 *		For each P_a, ask for the encryption of P_b = P_a xor (0_x, 0010 0000_x) 
-		 *		under the key K_b and denote the resulting ciphertext by C_b.
-		 *-------------------------------------------------------------------------------------------*/
+			for (int n = 1; n < nQuartets && !s.empty; n++) {
+				s = intersectKL(s, resolveKL81(&y[n], ko, ki, KL_R, 0));
+			}
 
-		for (int i = 0; i < 8; i++) {
-			if (i != 5)
-				Pb[i] = Pa[i];
-			else 
-				Pb[i] = Pa[i] ^ 0x10;
+			KL_FOREACH(s, kl) {
+				insertTripleArray(suggested, ko, ki, kl);
+			}
 		}
+	}
 
-		//printHex("Pb", Pb, 8);
+	free(y);
 
-		memcpy(Cb, &Pb[0], 8*sizeof(*Pb));
-		KeySchedule(Kb);
-		Kasumi(Cb);
+	if (__atomic_sub_fetch(&(job -> chunksLeft[g]), 1, __ATOMIC_ACQ_REL) == 0)
+		sweptKL81RCandidate(job);
+}
 
-		//printHex("Cb", Cb, 8);
+/*----------------------------------- Parallel K3, K5 --------------------------------------*/
 
-		/*-------------------------------------------------------------------------------------------
-		 *      Store the pairs (C_a , C_b) in a hash table indexed by the
-		 *      32-bit value C_b^R (i.e., the right half of C_b ).
-		 *-------------------------------------------------------------------------------------------*/
+#define K3_CHUNKS 4096		// chunks of the 2^16 K3 values given to the worker threads
+#define K3_GROUP 256		// chunks searched between two checkpoints
 
-		memcpy(indexDC, &Cb[4], 4*sizeof(*Cb));
-		//printHex("INDEX", indexDC, 4);
+struct searchK3K5Job {
+	u8 *partialKa;						// candidate key, K3 and K5 still to guess
+	int firstChunk;						// chunk 0 of the pool is this K3 chunk
+	u64 P, C;							// known plaintext and its ciphertext
+	int found;							// set by the worker that finds the key: the others stop
+	u8 key[16];							// the key found
+	u8 (*guessedKa)[TRIAL_BATCH][16];	// one trial batch per thread (bitslice engine)
+	unsigned long long *keys;			// keys tried by each thread
+	double *seconds;					// time spent by each thread
+};
 
-		addDataCollectionEntry(indexDC, Ca, Cb);
-		//printEntries();
+// Try every (K3, K5) with K3 in chunk <firstChunk + chunk>, TRIAL_BATCH K5 guesses at a time:
+// guess t of the batch has K5 = k5 + t. A guess is dropped as soon as the right half of P after
+// round 7 differs from the right half of C, which round 8 leaves unchanged.
+void searchK3K5Chunk(void *arg, int chunk, int thread) {
+	struct searchK3K5Job *job = arg;
+	int k3PerChunk = 0x10000 / K3_CHUNKS;
+	double start = wallClock();
+#if USE_BITSLICE
+	u8 (*guessedKa)[16] = job -> guessedKa[thread];
+
+	for (int t = 0; t < TRIAL_BATCH; t++) {
+		memcpy(guessedKa[t], job -> partialKa, 16*sizeof(u8));
+	}
+#else
+	// Expanded once: each guess only rewrites the subkeys built from K3 and K5
+	KasumiKey guessedKs;
+	KeySchedule_r(&guessedKs, job -> partialKa);
+#endif
+
+	chunk += job -> firstChunk;
+
+	for (int k3 = chunk * k3PerChunk; k3 < (chunk + 1) * k3PerChunk; k3++) {
+#if !USE_BITSLICE
+		KeyScheduleWord_r(&guessedKs, 2, k3);
+#endif
+		for (int k5 = 0x0000; k5 <= 0xffff; k5 += TRIAL_BATCH) {
+			int hit = -1;		// index in the batch of the key that maps P to C
+
+			if (__atomic_load_n(&(job -> found), __ATOMIC_RELAXED))
+				goto done;
+
+#if USE_BITSLICE
+			for (int t = 0; t < TRIAL_BATCH; t++) {
+				guessedKa[t][4] = k3 >> 8;
+				guessedKa[t][5] = k3 & 0xff;
+				guessedKa[t][8] = (k5 + t) >> 8;
+				guessedKa[t][9] = (k5 + t) & 0xff;
+			}
 
-		if (j > z * (nPlaintext/100.0)) {
-			printProgress(z/100.0);
-			z++;
-		} else if (j == nPlaintext - 1) 
-			printProgress(1);
+			hit = KasumiBitsliceSearchKeys(guessedKa, job -> P, job -> C, TRIAL_BATCH);
+#else
+			for (int t = 0; t < TRIAL_BATCH && hit < 0; t++) {
+				KeyScheduleWord_r(&guessedKs, 4, k5 + t);
+				if (KasumiTrialEncrypt(&guessedKs, job -> P, job -> C))
+					hit = t;
+			}
+#endif
+			job -> keys[thread] += TRIAL_BATCH;
+
+			if (hit >= 0) {
+				if (!__atomic_exchange_n(&(job -> found), 1, __ATOMIC_RELAXED)) {
+					memcpy(job -> key, job -> partialKa, 16*sizeof(u8));
+					job -> key[4] = k3 >> 8;
+					job -> key[5] = k3 & 0xff;
+					job -> key[8] = (k5 + hit) >> 8;
+					job -> key[9] = (k5 + hit) & 0xff;
+				}
+				goto done;
+			}
+		}
 	}
-	printf("\n");
 
-	printf("Data collection hash table overhead (GB): %.2f\n", HASH_OVERHEAD(hh, dataCollectionTable)/1000000000.0);
+	done:
+	job -> seconds[thread] += wallClock() - start;
+}
+
+/*----------------------------------------- PHASES -----------------------------------------*/
+
+int collectPhase(void *arg) {
+	struct attackRun *run = arg;
 
 	/*-------------------------------------------------------------------------------------------
-	 *	(b) Choose a structure of 2^24 ciphertexts of the form C_c = (Y_c , A xor 0010 0000_x),
-	 *		where A is the same constant as before, and Y_c assumes 2^24 arbitrary dif-
-	 *		ferent values. 
+	 * 1. Data Collection Phase:
 	 *-------------------------------------------------------------------------------------------*/
 
-	z = 1;
+	/*-------------------------------------------------------------------------------------------
+	 *	(a) Choose a structure of 2^24 ciphertexts of the form C_a = (X_a, A), where
+	 *		A is ﬁxed and X a assumes 2^24 arbitrary diﬀerent values. 
+	 *-------------------------------------------------------------------------------------------*/
 
-	printf("Generating Cc, Pc, Pd and Cd...\n");
+	// The oracle queries are answered ORACLE_BATCH blocks at a time through the multi-block
+	// interface of Kasumi.c, one chunk of the structure per worker thread (see oracleBatch())
+	int nPlaintext = run -> nPlaintext;
+	int nChunks = (nPlaintext + ORACLE_BATCH - 1) / ORACLE_BATCH;
+	struct oracleJob oracle = {nPlaintext, nextRandom(&(run -> seed))};
 
-	for (int j = 0; j < nPlaintext; j++) {
-		for (int i = 0; i < 4; i++) {
-			Cc[i] = rand() % 255;     // 255_10 = ff_16 = 11111111_2
-			//Cc[i] = 0xaa;
-		}
-		for (int i = 0; i < 4; i++) {
-			if (i != 1)
-				Cc[4+i] = A[i];
-			else
-				Cc[4+i] = A[i] ^ 0x10;
+	oracle.records = malloc(nPlaintext * sizeof(struct joinRecord));
+	oracle.partition = malloc(nChunks * sizeof(*oracle.partition));
+
+	printf("PHASE 1: DATA COLLECTION\n");
+
+	if (run -> structures.map) {
+		if (run -> structures.header -> key != keyFingerprint(Ka) || run -> structures.header -> count != 2 * (u64)nPlaintext) {
+			printf("The structures in %s are not of this key and size\n", structuresPath);
+			free(oracle.records);
+			free(oracle.partition);
+			run -> collectFailed = 1;
+			closeBoundedQueue(&(run -> quartets));
+			return 1;
 		}
+		printf("Reading the structures from %s\n", structuresPath);
+		savedStructures = run -> structures.records;
+	} else if (structuresPath) {
+		savingStructures = createDataset(&structuresWriter, structuresPath, DATASET_STRUCTURES, sizeof(u64[2]), checkpointSeed, keyFingerprint(Ka)) == 0;
+	}
+	if (quartetsPath) {
+		savingQuartets = createDataset(&quartetsWriter, quartetsPath, DATASET_QUARTETS, sizeof(struct rightQuartetsEntry), checkpointSeed, keyFingerprint(Ka)) == 0;
+	}
 
-		//printHex("Cc", Cc, 8);    
+	printf("Generating Ca, Pa, Pb and Cb...\n");
 
-		/*-------------------------------------------------------------------------------------------
-		 *		Ask for the decryption of the ciphertexts under the key K_c
-		 * 		and denote the plaintext corresponding to C_c by P_c. 
-		 *-------------------------------------------------------------------------------------------*/
+	/*-------------------------------------------------------------------------------------------
+	 *		Ask for the decryption of all the ciphertexts under the key K_a and denote the plain-
+	 * 		text corresponding to C_a by P_a.
+	 *		For each P_a, ask for the encryption of P_b = P_a xor (0_x, 0010 0000_x) 
+	 *		under the key K_b and denote the resulting ciphertext by C_b.
+	 *-------------------------------------------------------------------------------------------*/
 
-		memcpy(Pc, &Cc[0], 8*sizeof(*Cc));
-		KeySchedule(Kc);
-		KasumiDecipher(Pc);
+	parallelFor(nChunks, oracleABChunk, &oracle, printProgress);
+	printf("\n");
 
-		//printHex("Pc", Pc, 8);
+	/*-------------------------------------------------------------------------------------------
+	 *      Store the pairs (C_a , C_b) in a hash table indexed by the
+	 *      32-bit value C_b^R (i.e., the right half of C_b ).
+	 *-------------------------------------------------------------------------------------------*/
 
-		/*-------------------------------------------------------------------------------------------
-		 *		For each P_c , ask for the encryption of P_d = P_c xor (0_x , 0010 0000_x)
-		 *		under the key K_d and denote the resulting ciphertext by C_d .
-		 *-------------------------------------------------------------------------------------------*/
+	if (joinEngine == JOIN_SORT) {
+		joinAB = oracle.records;
+		nJoinAB = nPlaintext;
+		oracle.records = malloc(nPlaintext * sizeof(struct joinRecord));
+	} else {
+		parallelFor(DC_PARTITIONS, insertPartitionChunk, &oracle, NULL);
+		printf("Data collection hash table overhead (GB): %.2f\n", dataCollectionOverhead()/1000000000.0);
+	}
+	free(oracle.partition);
 
-		for (int i = 0; i < 8; i++) {
-			if (i != 5)
-				Pd[i] = Pc[i];
-			else
-				Pd[i] = Pc[i] ^ 0x10;
-		}
+	/*-------------------------------------------------------------------------------------------
+	 *	(b) Choose a structure of 2^24 ciphertexts of the form C_c = (Y_c , A xor 0010 0000_x),
+	 *		where A is the same constant as before, and Y_c assumes 2^24 arbitrary dif-
+	 *		ferent values. 
+	 *-------------------------------------------------------------------------------------------*/
 
-		//printHex("Pd", Pd, 8);
+	printf("Generating Cc, Pc, Pd and Cd...\n");
 
-		memcpy(Cd, &Pd[0], 8*sizeof(*Pd));
-		KeySchedule(Kd);
-		Kasumi(Cd);
+	/*-------------------------------------------------------------------------------------------
+	 *		Ask for the decryption of the ciphertexts under the key K_c
+	 * 		and denote the plaintext corresponding to C_c by P_c. 
+	 *		For each P_c , ask for the encryption of P_d = P_c xor (0_x , 0010 0000_x)
+	 *		under the key K_d and denote the resulting ciphertext by C_d .
+	 *-------------------------------------------------------------------------------------------*/
 
-		//printHex("Cd", Cd, 8);
+	/*-------------------------------------------------------------------------------------------
+	 *      Then, access the hash table in the entry
+	 *      corresponding to the value C_d^R xor 00100000_x , and for each pair (C_a, C_b)
+	 *      found in this entry, apply Step 2 on the quartet (C_a, C_b, C_c, C_d).
+	 *-------------------------------------------------------------------------------------------*/
 
-		/*-------------------------------------------------------------------------------------------
-		 *      Then, access the hash table in the entry
-		 *      corresponding to the value C_d^R xor 00100000_x , and for each pair (C_a, C_b)
-		 *      found in this entry, apply Step 2 on the quartet (C_a, C_b, C_c, C_d).
-		 *-------------------------------------------------------------------------------------------*/
+	oracle.seed = nextRandom(&(run -> seed));
+	oracle.out = &(run -> quartets);
+	if (joinEngine == JOIN_HASH) {
+		free(oracle.records);
+		oracle.records = NULL;
+	}
 
-		memcpy(indexDC, &Cd[4], 4*sizeof(*Cd));
-		indexDC[1] = indexDC[1] ^ 0x10;
-		//printHex("INDEX", index, 4);
+	parallelFor(nChunks, oracleCDChunk, &oracle, printProgress);
+	printf("\n");
+
+	if (run -> structures.map) {
+		savedStructures = NULL;
+		closeDataset(&(run -> structures));
+	} else if (savingStructures) {
+		savingStructures = 0;
+		if (closeDatasetWriter(&structuresWriter, 2 * (u64)nPlaintext) == 0)
+			printf("Structures saved to %s\n", structuresPath);
+	}
 
-		struct dataCollectionEntry *h;
+	// With -j hash each chunk of phase 1(b) has already pushed its quartets
+	if (joinEngine == JOIN_SORT) {
+		struct joinOutput out = {&(run -> quartets), 0};
 
-		h = findDataCollectionEntry(indexDC);
-		
-		if (h) {
+		joinCD = oracle.records;
+		nJoinCD = nPlaintext;
+		initQuartetArray(&(out.batch), QUARTET_BATCH);
+		sortMergeJoin(emitJoinedQuartet, &out);
+		pushQuartetBatch(out.queue, out.seq, &(out.batch), NULL, 0);
+	}
+
+	// Free the memory used for the first hash table: the data we need now on are on the new hash table
+	deleteAllDataCollectionEntries();
 
-			/*-------------------------------------------------------------------------------------------
-			 * 2. Identifying the Right Quartets:
-			 *-------------------------------------------------------------------------------------------*/
+	closeBoundedQueue(&(run -> quartets));
+	return 0;
+}
 
-			/*-------------------------------------------------------------------------------------------
-			 *	(a) Insert the approximately 2^16 remaining quartets (C_a, C_b, C_c, C_d) into a
-					hash table indexed by the 32-bit value C_a^L XOR C_c^L , and apply Step 3 only
-					to bins which contain at least three quartets.
-			 *-------------------------------------------------------------------------------------------*/
+// Phase 1 from the -q file of an earlier run: the mapped quartets go to phase 2 in place
+int readQuartetsPhase(void *arg) {
+	struct attackRun *run = arg;
+	const struct rightQuartetsEntry *r = run -> candidates.records;
+	size_t n = run -> candidates.header -> count;
 
-			memcpy(Ca, &(h -> CaCb)[0], 8*sizeof(*Ca));
-			memcpy(Cb, &(h -> CaCb)[8], 8*sizeof(*Cb));
+	printf("PHASE 1: DATA COLLECTION\n");
 
-			//printHex("Ca", Ca, 8);
-			//printHex("Cb", Cb, 8);
+	if (run -> candidates.header -> key != keyFingerprint(Ka)) {
+		printf("The quartets in %s were collected under another key\n", quartetsPath);
+		run -> collectFailed = 1;
+		closeBoundedQueue(&(run -> quartets));
+		return 1;
+	}
 
-			memcpy(indexRQ, &Ca[0], 4*sizeof(*Ca));
-			for (int i = 0; i < 4; i++) {
-				indexRQ[i] = indexRQ[i] ^ Cc[i];
-			}
+	printf("Reading %zu candidate quartets from %s...\n", n, quartetsPath);
 
-			//printHex("Cc", Cc, 8);
-			//printHex("Cd", Cd, 8);
-			//printHex("index", indexRQ, 4);
+	for (size_t i = 0, seq = 0; i < n; i += QUARTET_BATCH, seq++) {
+		pushQuartetBatch(&(run -> quartets), seq, NULL, r + i, (n - i < QUARTET_BATCH) ? n - i : QUARTET_BATCH);
+	}
 
-			addRightQuartetsEntry(indexRQ, Ca, Cb, Cc, Cd);
+	closeBoundedQueue(&(run -> quartets));
+	return 0;
+}
 
-			//printHex("FOUND", h -> CaCb, 8);
-			//printHex("FOUND", h -> CaCb + 8, 8);
+int filterPhase(void *arg) {
+	/*-------------------------------------------------------------------------------------------
+	 * 2. Identifying the Right Quartets:
+	 *-------------------------------------------------------------------------------------------*/
+
+	/*-------------------------------------------------------------------------------------------
+	 *	(a) Insert the approximately 2^16 remaining quartets (C_a, C_b, C_c, C_d) into a
+			hash table indexed by the 32-bit value C_a^L XOR C_c^L , and apply Step 3 only
+			to bins which contain at least three quartets.
+	 *-------------------------------------------------------------------------------------------*/
 
-			//free(h);		// se lo lascio segfaulta
+	// The batches arrive in the order the chunks end: the quartets are collected in batch
+	// order, as in the serial loop
+	struct attackRun *run = arg;
+	RightQuartetsTable *t = &(run -> rightQuartets);
+	struct quartetBatch *b, **pending = NULL;
+	size_t sizePending = 0, next = 0;
+
+	while ((b = popBoundedQueue(&(run -> quartets))) != NULL) {
+		if (b -> seq >= sizePending) {
+			size_t size = sizePending ? 2 * sizePending : 1024;
+
+			while (b -> seq >= size) size *= 2;
+			pending = realloc(pending, size * sizeof(*pending));
+			memset(pending + sizePending, 0, (size - sizePending) * sizeof(*pending));
+			sizePending = size;
 		}
-		//else printf("id unknown\n");
+		pending[b -> seq] = b;
 
-		if (j > z * (nPlaintext/100.0)) {
-			printProgress(z/100.0);
-			z++;
-		} else if (j == nPlaintext - 1) 
-			printProgress(1);
+		for (; next < sizePending && pending[next]; next++) {
+			collectQuartetBatch(pending[next], t);
+			pending[next] = NULL;
+		}
 	}
-	printf("\n");
-	/* leaves about 2^16 quartets with the required diﬀerences */
-	printf("I have found 2^%.1f potential right quartets.\n", log((double)HASH_COUNT(rightQuartetsTable))/log(2));
+	free(pending);
 
-	// Free the memory used for the first hash table: the data we need now on are on the new hash table
-	deleteAllDataCollectionEntries();
+	if (run -> candidates.map) {
+		closeDataset(&(run -> candidates));
+	}
+	if (run -> collectFailed) {
+		return 1;
+	}
+
+	if (savingQuartets) {
+		savingQuartets = 0;
+		if (closeDatasetWriter(&quartetsWriter, nSavedQuartets) == 0)
+			printf("Candidate quartets saved to %s\n", quartetsPath);
+	}
+
+	printf("I have found 2^%.1f potential right quartets.\n", log((double)t -> used)/log(2));
 
 	/*-------------------------------------------------------------------------------------------
 	 *		apply Step 3 only to bins which contain at least three quartets.
 	 *-------------------------------------------------------------------------------------------*/
 
 	printf("PHASE 2: IDENTIFIING RIGHT QUARTETS\n");
-	printf("Right quartets hash table overhead (GB): %.2f\n", HASH_OVERHEAD(hh, rightQuartetsTable)/1000000000.0);
-
-	sortRightQuartetsTable();
-
-	struct rightQuartetsEntry *q, *tmp;
-	u8 currentIndex[4];
-	u8 startIndex[4];
-	memcpy(currentIndex, rightQuartetsTable -> index, 4*sizeof(*currentIndex));
-	memcpy(startIndex, rightQuartetsTable -> index, 4*sizeof(*startIndex));
-	int counter = 0;
-
-	HASH_ITER(hh, rightQuartetsTable, q, tmp) {
-		if (compareArray(q -> index, currentIndex, 4)) {
-			// Found a collision
-			counter++;
-			/*
-			if (counter == 3) {										
-				printf("3-collision found!\n");
-				printHex("Right quartet index", q -> index, 4);
-			}
-			*/
-		} else 	{
-			// Didn't find a collision: delete the elements with no sufficient collisions
-			if (counter < 3) {
-				while (counter > 0) {				
-					deleteRightQuartetsEntry(findRightQuartetsEntry(currentIndex));
-					counter--;
-				}
-			}
-			counter = 1;
-			memcpy(currentIndex, q -> index, 4 * sizeof(*currentIndex));
-		}
-	}
+	printf("Right quartets table size (GB): %.2f\n", t -> size * sizeof(struct rightQuartetsEntry)/1000000000.0);
 
-	// Delete the last quartet if not in a 3-collision
-	if (counter < 3) {
-		deleteRightQuartetsEntry(findRightQuartetsEntry(currentIndex));
-	}
+	sortRightQuartetsTable(t);
+	filterRightQuartetsTable(t, 3);
 
-	printRightQuartetsEntries();
-	printf("I have found %d right quartets.\n", HASH_COUNT(rightQuartetsTable));
+	printRightQuartetsEntries(t);
+	printf("I have found %zu right quartets.\n", t -> used);
 
 	/*
 	u8* rightIndex = rightQuartetsTable -> index;
@@ -1395,16 +1902,21 @@ int main(void) {
 
 	//printf("Right quartets found: \t%d, of which are real: \t%d\n", rightQuartets, realRightQuartets);
 
-	/*-------------------------------------------------------------------------------------------
-	 * 3. Analyzing Right Quartets:
-	 *-------------------------------------------------------------------------------------------*/
-
-	if (HASH_COUNT(rightQuartetsTable) == 0) {
+	if (t -> used == 0) {
 		printf("No right quartet found. Can't proceed with the attack.\n");
 		//exit(0);
-		goto exit;
+		return 1;
 	}
 
+	saveCheckpoint(run, STAGE_3A, 0, 0, 1);
+	return 0;
+}
+
+int guessKL82Phase(void *arg) {
+	/*-------------------------------------------------------------------------------------------
+	 * 3. Analyzing Right Quartets:
+	 *-------------------------------------------------------------------------------------------*/
+
 	/*-------------------------------------------------------------------------------------------
 	 *	(a) For each remaining quartet (C_a, C_b, C_c, C_d), guess the 32-bit value of
 	 *		KO_8,1 and KI_8,1 
@@ -1412,30 +1924,31 @@ int main(void) {
 
 	printf("PHASE 3: ANALYZING RIGHT QUARTETS\n");
 
-	int cont = 1;
+	struct attackRun *run = arg;
+	RightQuartetsTable *t = &(run -> rightQuartets);
+	struct rightQuartetsEntry *q;
+	CandidateSet suggested;
+	Quartet x;
+	u32 done = (run -> resume.stage == STAGE_3A) ? run -> resume.cursor : 0;
+	int cont = done + 1;
 	u16 KO81, KI81;
 	u8 index[4];
 
-	for (q = rightQuartetsTable; q != NULL; q = q->hh.next) {
+	buildFITable();
+
+	for (q = t -> entry + done; q < t -> entry + t -> used; q++) {
 		printf("Analyzing quartet n. %d\n", cont);
 
-		for (int i = 0; i < 8; i++) {
-			Ca[i] = (q -> CaCbCcCd)[i];
-			Cb[i] = (q -> CaCbCcCd)[i + 8];
-			Cc[i] = (q -> CaCbCcCd)[i + 16];
-			Cd[i] = (q -> CaCbCcCd)[i + 24];
+		decodeQuartet(q, &x);
 
-			if (i < 4) {
-				index[i] = (q -> index)[i];
-			}
-		}
+		rightQuartetIndex(q, index);
 
 		/*
-		printHex("index", q -> index, 4);
-		printHex("Ca", Ca, 8);				
-		printHex("Cb", Cb, 8);
-		printHex("Cc", Cc, 8);				
-		printHex("Cd", Cd, 8);
+		printHex("index", index, 4);
+		printHex("Ca", q -> CaCbCcCd, 8);				
+		printHex("Cb", q -> CaCbCcCd + 8, 8);
+		printHex("Cc", q -> CaCbCcCd + 16, 8);				
+		printHex("Cd", q -> CaCbCcCd + 24, 8);
 		*/
 
 		/*-------------------------------------------------------------------------------------------
@@ -1447,83 +1960,46 @@ int main(void) {
 
 		printf("Guessing the keys KO81 and KI81...\n");
 
-		z = 0;	// Initializing the progress bar
-
 		int nSuggestedKeys = 0;
 
-		KO81 = 0x0000;
-		KI81 = 0x0000;	
-
-		for (int ko = 0; ko <= 0xffff; ko++) {
-			KI81 = 0x0000;
-			
-			for (int ki = 0; ki <= 0x01ff; ki++) {
-				Array a = findKL82R(Ca, Cb, Cc, Cd, KO81, KI81);
-
-				if (a.used > 0) {
-					for (int i = 0; i < a.used; i++) {
-						addOrREntry(KO81, KI81, a.array[i], index);
-						nSuggestedKeys++;
-					}
-				}
+		// The KO81 range is split in KO_CHUNKS chunks guessed in parallel, each one into its own
+		// list: the lists are voted in chunk order, the same order as the serial loop.
+		struct guessKL82RJob job = {&x, malloc(KO_CHUNKS * sizeof(TripleArray)),
+			malloc(KO_CHUNKS * sizeof(*job.passed))};
 
-				freeArray(&a);
-				KI81++;
+		parallelFor(KO_CHUNKS, guessKL82RChunk, &job, printProgress);
 
-				if ((u32)((KO81<<16)+(KI81)) > z * (pow(2,32)/100.0)) {
-					printProgress(z/100.0);
-					z++;
-				} else if ((u32)((KO81<<16)+(KI81)) == 0xffff01ff - 1) {
-					printProgress(1);
-				}
+		for (int c = 0; c < KO_CHUNKS; c++) {
+			for (size_t i = 0; i < job.suggested[c].used; i++) {
+				u16 *k = job.suggested[c].triple[i];
+				addOrREntry(&(run -> votes), k[0], k[1], k[2], q -> index);
+				nSuggestedKeys++;
 			}
-
-			KO81++;
+			freeTripleArray(&(job.suggested[c]));
 		}
+		free(job.suggested);
+
 		printf("\n");
+		printKL82RStages(job.passed);
+		free(job.passed);
 		//printf("Suggested keys: \t%d\n", nSuggestedKeys);
-		//printf("Keys in the set OR: \t%d\n", HASH_COUNT(OrSet));
-		//printf("Keys in the set tmp: \t%d\n", HASH_COUNT(tmpOrSet));
+		//printf("Keys in the set OR: \t%zu\n", OrSet.used);
 		//printOrEntries();
 
 		nSuggestedKeys = 0;
 		cont++;
-	}
-
-	//printRightQuartetsEntries();
-
-	// cerco quali delle chiavi suggerite hanno il maggior numero di suggerimenti e salvo l'indice corrispondente
-	u8 maxFreq = 0;
-	u8 rightIndex[4];
 
-	for (int i = 0; i < 4; i++) {
-		rightIndex[i] = (rightQuartetsTable -> index)[i];
+		saveCheckpoint(run, STAGE_3A, cont - 1, 0, 0);
 	}
 
-	struct OrREntry *orr, *tmporr;
-
-	for (orr = OrRSet; orr != NULL; orr = orr -> hh.next) {
-		if (orr -> frequency[4] > maxFreq) {
-			maxFreq = orr -> frequency[4];
-
-			//printf("maxFreq: %d\n", maxFreq);
-			//printf("(KO81, KI81^R, KL82^R, frequency):\t(%04x, %04x, %04x, %d)\n", orr -> key[0], orr -> key[1], orr -> key[2], orr -> frequency[4]);
+	freeFITable();
 
-			for (int i = 0; i < 4; i++) {
-				rightIndex[i] = (orr -> frequency[i]);
-			}
-		}
-	}
+	//printRightQuartetsEntries();
 
-	//printf("Max frequency: %d\n", maxFreq);
+	// tengo solo le chiavi con il maggior numero di suggerimenti e salvo l'indice corrispondente
+	u32 rightIndex = keepMostFrequentOrREntries(&(run -> votes), t);
 
-	// elimino da or set R tutti i suggerimenti di chiavi per cui la frequenza non è quella massima
-	HASH_ITER(hh, OrRSet, orr, tmporr) {
-		//printf("orr frequency: %d\n", orr -> frequency[4]);
-		if (orr -> frequency[4] != maxFreq) {
-			deleteOrREntry(findOrREntry(orr -> key[0], orr -> key[1], orr -> key[2]));
-		}
-	}
+	//printf("Max frequency: %u\n", maxFrequency);
 
 	//printf("All OrR entries:\n");
 	//printOrREntries();
@@ -1531,70 +2007,57 @@ int main(void) {
 	//printRightQuartetsEntries();
 
 	// elimino da right quartets tutti i quartetti per cui l'indice non è quello corretto
-	HASH_ITER(hh, rightQuartetsTable, q, tmp) {
-		if (!compareArray(q -> index, rightIndex, 4)) {
-			//deleteRightQuartetsEntry(findRightQuartetsEntry(q2 -> index));
-			deleteRightQuartetsEntry(q);
-		} else {
-			printHex("index", q -> index, 4);
+	size_t kept = 0;
+
+	for (q = t -> entry; q < t -> entry + t -> used; q++) {
+		if (q -> index == rightIndex) {
+			rightQuartetIndex(q, index);
+			printHex("index", index, 4);
+			t -> entry[kept++] = *q;
 		}
 	}
+	t -> used = kept;
 
 	//printf("All rightQuartets entries:\n");
 	//printRightQuartetsEntries();
 
-	printf("The number of real right quartets is: %d\n", HASH_COUNT(rightQuartetsTable));
+	printf("The number of real right quartets is: %zu\n", t -> used);
 		
 	/*-------------------------------------------------------------------------------------------
 	 *		Since all the right quartets suggest the same key, all the wrong keys are discarded
 	 * 		and the attacker obtains the correct value of (KO_8,1, KI_8,1, KL_8,2)
 	 *-------------------------------------------------------------------------------------------*/
 
-	//printf("I have found %d possible values for subkeys KO81, KI81, KL82:\n", HASH_COUNT(OrRSet));
+	//printf("I have found %zu possible values for subkeys KO81, KI81, KL82:\n", nOrRSet);
 	//printOrREntries();
 
-	if (HASH_COUNT(OrRSet) == 0) {
+	if (run -> votes.used == 0) {
 		printf("The found quartets are not right quartets. Cannot proceed with the attack\n");
-		goto exit;
+		return 1;
 	}
 
-	struct OrREntry *or;
 	cont = 1;
+	initCandidateSet(&suggested);
 
 	// TODO
-	for (q = rightQuartetsTable; q != NULL; q = q->hh.next) {
+	for (q = t -> entry; q < t -> entry + t -> used; q++) {
 		//printf("Analyzing quartet n. %d\n", cont);
 
-		for (int i = 0; i < 8; i++) {
-			Ca[i] = (q -> CaCbCcCd)[i];
-			Cb[i] = (q -> CaCbCcCd)[i + 8];
-			Cc[i] = (q -> CaCbCcCd)[i + 16];
-			Cd[i] = (q -> CaCbCcCd)[i + 24];
-		}
+		decodeQuartet(q, &x);
+
+		for (size_t e = 0; e < run -> votes.used; e++) {
+			u64 or = run -> votes.entry[e].key - 1;
 
-		for (or = OrRSet; or != NULL; or = or -> hh.next) {					
 			for (int ki = 0x0000; ki <= 0x007f; ki++) {
 
-				KI81 = (u16)((ki << 9) + (or -> key[1]));
-				KO81 = or -> key[0];
-				Array a = findKL82L(Ca, Cb, Cc, Cd, KO81, KI81, or -> key[2]);
-
-				if (a.used > 0) {
-					for (int i = 0; i < a.used; i++) {
-
-						if (cont == 1) {									// devo riempire il set di partenza
-							addOrEntry(KO81, KI81, a.array[i]);
-						} else {											// devo riempire un altro set, dopo di che farò l'intersezione
-							if (findOrEntry(KO81, KI81, a.array[i])) {	
-								addTmpOrEntry(KO81, KI81, a.array[i]);		// se la tripla è in OrSet, allora la aggiungo ad un nuovo set
-							}
-						}
-						
-						//nSuggestedKeys++;
-					}
-				}
+				KI81 = (u16)((ki << 9) + CANDIDATE_KI(or));
+				KO81 = CANDIDATE_KO(or);
+				KLSet s = findKL82L(&x, KO81, KI81, CANDIDATE_KL(or));
 
-				freeArray(&a);
+				KL_FOREACH(s, kl) {
+					addCandidate(&suggested, CANDIDATE(KO81, KI81, kl));
+					//nSuggestedKeys++;
+				}
 
 				/*
 				if ((u32)((KO81<<16)+(KI81)) > z * (pow(2,32)/100.0)) {
@@ -1607,267 +2070,205 @@ int main(void) {
 			}
 		}
 
-		if (cont > 1) {
-			// assegno ad OrSet il nuovo set provvisorio
-			deleteAllOrEntries();
-
-			struct tmpOrEntry *k;
-			for (k = tmpOrSet; k != NULL; k = k -> hh.next) {
-				addOrEntry(k -> index[0], k -> index[1], k -> index[2]);
-			}
-
-			// libero il set provvisorio
-			deleteAllTmpOrEntries();
-		}
+		mergeCandidates(&(run -> OrSet), &suggested, cont);
 		
 		//nSuggestedKeys = 0;
 		cont++;
 	}
 
-	deleteAllOrREntries();
+	freeCandidateSet(&suggested);
+	deleteAllOrREntries(&(run -> votes));
 
-	printf("I have found %d possible values for subkeys KO81, KI81, KL82:\n", HASH_COUNT(OrSet));
-	printOrEntries();
+	printf("I have found %zu possible values for subkeys KO81, KI81, KL82:\n", run -> OrSet.used);
+	printOrEntries(&(run -> OrSet));
 
-	if (HASH_COUNT(OrSet) == 0) {
+	if (run -> OrSet.used == 0) {
 		printf("The found quartets are not right quartets. Cannot proceed with the attack\n");
-		goto exit;
+		return 1;
 	}
 
+	saveCheckpoint(run, STAGE_3B, 0, 0, 1);
+	return 0;
+}
+
+int guessKL81Phase(void *arg) {
 	/*-------------------------------------------------------------------------------------------
 	 *	(b) Guess the 32-bit value of KO_8,3 and KI_8,3
 	 *-------------------------------------------------------------------------------------------*/
 
-	// in teoria dovrei prima riordinarli, ma in realtà sono già ordinati come serve a me
-	// per ogni combinazione (KL81, KI81)
-
-	cont = 1;
-	u16 prevKO81 = 0x0000;
-	u16 prevKI81 = 0x0000;
-	u16 KO83, KI83;
-	struct OrEntry *k;
-	int nSuggestedKeys;
+	// OrSet is sorted: the triples of each (KO81, KI81) are consecutive
+
+	struct attackRun *run = arg;
+	const RightQuartetsTable *t = &(run -> rightQuartets);
+	const CandidateSet *OrSet = &(run -> OrSet);
+	const struct rightQuartetsEntry *q;
+	CandidateSet suggested, AndRSet, AndSet;
+	Quartet x;
+	u16 KO81, KI81, KO83, KI83;
+	u32 done;
+	int cont;
+	Quartet *quartets = malloc(t -> used * sizeof(Quartet));
+	struct guessKL81RJob kl81 = {malloc(OrSet -> used * sizeof(u16[2])), 0, 0, quartets, t -> used};
+
+	for (size_t n = 0; n < t -> used; n++) {
+		decodeQuartet(&(t -> entry[n]), &quartets[n]);
+	}
 
-	if (OrSet -> index[0] == 0x0000) prevKO81 = 0x0001;
-	if (OrSet -> index[1] == 0x0000) prevKI81 = 0x0001;
+	for (size_t k = 0; k < OrSet -> used; k++) {
+		KO81 = CANDIDATE_KO(OrSet -> key[k]);
+		KI81 = CANDIDATE_KI(OrSet -> key[k]);
 
-	for (k = OrSet; k != NULL; k = k -> hh.next) {
-		KO81 = k -> index[0];
-		KI81 = k -> index[1];
+		if (k == 0 || KO81 != CANDIDATE_KO(OrSet -> key[k - 1]) || KI81 != CANDIDATE_KI(OrSet -> key[k - 1])) {
+			kl81.candidate[kl81.nCandidates][0] = KO81;
+			kl81.candidate[kl81.nCandidates][1] = KI81;
+			kl81.nCandidates++;
+		}
+	}
 
-		//KO81 = 0x2013;
-		//KI81 = 0x2310;
+	kl81.suggested = calloc((size_t)kl81.nCandidates * KO_CHUNKS, sizeof(TripleArray));
+	kl81.chunksLeft = malloc(kl81.nCandidates * sizeof(int));
+	pthread_mutex_init(&(kl81.lock), NULL);
+	kl81.run = run;
 
-		if ((KO81 != prevKO81) || (KI81 != prevKI81)) {
-			printf("KO81: %04x, KI81: %04x\n", KO81, KI81);
-			cont = 1;
-
-			/*-------------------------------------------------------------------------------------------
-			 *		compute the input and output diﬀerences of the AND operation in both pairs
-					of each quartet. For each bit of the 16-bit AND operation of F L8, 
-					the possible values of the corresponding bit of KL_8,1 are given
-			 *-------------------------------------------------------------------------------------------*/
-
-			// ho una nuova combinazione di chiavi: per ogni quartetto devo generare tutte le possibili KO83 e KI83 e cercare KL81
-			for (q = rightQuartetsTable; q != NULL; q = q->hh.next) {
-				printf("Analyzing quartet n. %d\n", cont);
-
-				for (int i = 0; i < 8; i++) {
-					Ca[i] = (q -> CaCbCcCd)[i];
-					Cb[i] = (q -> CaCbCcCd)[i + 8];
-					Cc[i] = (q -> CaCbCcCd)[i + 16];
-					Cd[i] = (q -> CaCbCcCd)[i + 24];
-				}
+	// Resumed: the first values were swept before the checkpoint, and what they found is in
+	// run -> swept. Their triples go back in the first list of each candidate.
+	done = (run -> resume.stage == STAGE_3B) ? run -> resume.cursor : 0;
 
-				/*
-				printHex("index", q -> index, 4);
-				printHex("Ca", Ca, 8);				
-				printHex("Cb", Cb, 8);
-				printHex("Cc", Cc, 8);				
-				printHex("Cd", Cd, 8);
-				*/
+	for (int g = 0; g < kl81.nCandidates; g++) {
+		kl81.chunksLeft[g] = ((u32)g < done) ? 0 : KO_CHUNKS;
+	}
+	for (size_t i = 0; i < run -> nSwept; i++) {
+		u16 *r = run -> swept[i];
+		TripleArray *list = &(kl81.suggested[(size_t)r[0] * KO_CHUNKS]);
 
-				printf("Guessing the keys KO83 and KI83...\n");
+		if (list -> size == 0) initTripleArray(list, 256);
+		insertTripleArray(list, r[1], r[2], r[3]);
+	}
+	kl81.first = kl81.nSwept = done;
 
-				z = 0;	// Initializing the progress bar
-				nSuggestedKeys = 0;
+	/*-------------------------------------------------------------------------------------------
+	 *		compute the input and output diﬀerences of the AND operation in both pairs
+			of each quartet. For each bit of the 16-bit AND operation of F L8, 
+			the possible values of the corresponding bit of KL_8,1 are given
+	 *-------------------------------------------------------------------------------------------*/
 
-				KO83 = 0x0000;
-				KI83 = 0x0000;	
+	printf("Guessing the keys KO83 and KI83 for %d values of (KO81, KI81)...\n", kl81.nCandidates - (int)done);
 
-				for (int ko = 0; ko <= 0xffff; ko++) {
-					KI83 = 0x0000;
-					
-					for (int ki = 0; ki <= 0x01ff; ki++) {
-						
-						Array a = findKL81R(Ca, Cb, Cc, Cd, KO81, KI81, KO83, KI83);
-						
-						if (a.used > 0) {
-							for (int i = 0; i < a.used; i++) {
-
-								//printf("KO81, KI81, KO83, KI83, KL81:\t%04x, %04x, %04x, %04x, %04x\n", KO81, KI81, KO83, KI83, a.array[i]);
-
-								if (cont == 1) {									// devo riempire il set di partenza
-									addAndREntry(KO83, KI83, a.array[i]);
-								} else {											// devo riempire un altro set, dopo di che farò l'intersezione
-									if (findAndREntry(KO83, KI83, a.array[i])) {	
-										addTmpAndREntry(KO83, KI83, a.array[i]);		// se la tripla è in OrSet, allora la aggiungo ad un nuovo set
-									}
-								}
-								
-								nSuggestedKeys++;
-							}
-						}
-
-						freeArray(&a);
-
-						KI83++;
-
-						if ((u32)((KO83<<16)+(KI83)) > z * (pow(2,32)/100.0)) {
-							printProgress(z/100.0);
-							z++;
-						} else if ((u32)((KO83<<16)+(KI83)) == 0xffff01ff - 1) {
-							printProgress(1);
-						}
-					}
+	initCandidateSet(&suggested);
+	initCandidateSet(&AndRSet);
+	initCandidateSet(&AndSet);
+	parallelFor((kl81.nCandidates - done) * KO_CHUNKS, guessKL81RChunk, &kl81, printProgress);
+	printf("\n");
 
-					KO83++;
-				}
-				printf("\n");
-				//printf("Suggested keys: \t%d\n", nSuggestedKeys);
-				//printf("Keys in the set AND: \t%d\n", HASH_COUNT(AndSet));
-				//printf("Keys in the set tmp: \t%d\n", HASH_COUNT(tmpAndSet));
-				//printAndEntries();
-				//printTmpAndEntries();
+	for (int g = 0; g < kl81.nCandidates; g++) {
+		KO81 = kl81.candidate[g][0];
+		KI81 = kl81.candidate[g][1];
 
-				if (cont > 1) {
-					deleteAllAndREntries();
+		//KO81 = 0x2013;
+		//KI81 = 0x2310;
 
-					struct tmpAndREntry *k;
+		printf("KO81: %04x, KI81: %04x\n", KO81, KI81);
 
-					for (k = tmpAndRSet; k != NULL; k = k -> hh.next) {
-						addAndREntry(k -> index[0], k -> index[1], k -> index[2]);
-					}
+		// le KO83, KI83 e KL81 suggerite da tutti i quartetti insieme
+		TripleArray *chunks = kl81.suggested + (size_t)g * KO_CHUNKS;
 
-					deleteAllTmpAndREntries();
-				}
-				
-				nSuggestedKeys = 0;
-				cont++;
+		for (int c = 0; c < KO_CHUNKS; c++) {
+			for (size_t i = 0; i < chunks[c].used; i++) {
+				u16 *t = chunks[c].triple[i];
+				//printf("KO81, KI81, KO83, KI83, KL81:\t%04x, %04x, %04x, %04x, %04x\n", KO81, KI81, t[0], t[1], t[2]);
+				addCandidate(&suggested, CANDIDATE(t[0], t[1], t[2]));
 			}
+			freeTripleArray(&chunks[c]);
+		}
 
-			//printOrEntries();
-			//printf("Keys in the set AND: \t%d\n", HASH_COUNT(AndRSet));
-			//printAndREntries();			
+		mergeCandidates(&AndRSet, &suggested, 1);
 
-			// TODO		
+		//printf("Keys in the set AND: \t%zu\n", AndRSet.used);
 
-			struct AndREntry *er;
-			cont = 1;
+		// TODO		
 
-			for (q = rightQuartetsTable; q != NULL; q = q -> hh.next) {
-				//printf("Analyzing quartet n. %d\n", cont);
+		cont = 1;
 
-				for (int i = 0; i < 8; i++) {
-					Ca[i] = (q -> CaCbCcCd)[i];
-					Cb[i] = (q -> CaCbCcCd)[i + 8];
-					Cc[i] = (q -> CaCbCcCd)[i + 16];
-					Cd[i] = (q -> CaCbCcCd)[i + 24];
-				}
+		for (q = t -> entry; q < t -> entry + t -> used; q++) {
+			//printf("Analyzing quartet n. %d\n", cont);
 
-				for (er = AndRSet; er != NULL; er = er -> hh.next) {
-					for (int ki = 0; ki <= 0x007f; ki++) {
-						
-						KI83 = (u16)((ki << 9) + (er -> index[1]));
-						KO83 = er -> index[0];
-
-						Array a = findKL81L(Ca, Cb, Cc, Cd, KO81, KI81, KO83, KI83, er -> index[2]);
-						
-						if (a.used > 0) {
-							for (int i = 0; i < a.used; i++) {
-
-								//printf("KO81, KI81, KO83, KI83, KL81:\t%04x, %04x, %04x, %04x, %04x\n", KO81, KI81, KO83, KI83, a.array[i]);
-
-								if (cont == 1) {									// devo riempire il set di partenza
-									addAndEntry(KO83, KI83, a.array[i]);
-								} else {											// devo riempire un altro set, dopo di che farò l'intersezione
-									if (findAndEntry(KO83, KI83, a.array[i])) {	
-										addTmpAndEntry(KO83, KI83, a.array[i]);		// se la tripla è in OrSet, allora la aggiungo ad un nuovo set
-									}
-								}
-								
-								//nSuggestedKeys++;
-							}
-						}
-
-						freeArray(&a);
-
-						/*
-						if ((u32)((KO83<<16)+(KI83)) > z * (pow(2,32)/100.0)) {
-							printProgress(z/100.0);
-							z++;
-						} else if ((u32)((KO83<<16)+(KI83)) == pow(2,32) - 1) {
-							printProgress(1);
-						}
-						*/
-					}
-				}
-
-				//deleteAllAndREntries();
+			decodeQuartet(q, &x);
 
-				if (cont > 1) {
-					deleteAllAndEntries();
+			for (size_t e = 0; e < AndRSet.used; e++) {
+				u64 er = AndRSet.key[e];
 
-					struct tmpAndEntry *k;
+				for (int ki = 0; ki <= 0x007f; ki++) {
+					
+					KI83 = (u16)((ki << 9) + CANDIDATE_KI(er));
+					KO83 = CANDIDATE_KO(er);
 
-					for (k = tmpAndSet; k != NULL; k = k -> hh.next) {
-						addAndEntry(k -> index[0], k -> index[1], k -> index[2]);
+					KLSet s = findKL81L(&x, KO81, KI81, KO83, KI83, CANDIDATE_KL(er));
+					
+					KL_FOREACH(s, kl) {
+						//printf("KO81, KI81, KO83, KI83, KL81:\t%04x, %04x, %04x, %04x, %04x\n", KO81, KI81, KO83, KI83, kl);
+						addCandidate(&suggested, CANDIDATE(KO83, KI83, kl));
 					}
-
-					deleteAllTmpAndEntries();
 				}
-				
-				nSuggestedKeys = 0;
-				cont++;
 			}
 
-			printf("Keys in the set AND: \t%d\n", HASH_COUNT(AndSet));
-			printAndEntries();	
+			mergeCandidates(&AndSet, &suggested, cont);
+			cont++;
 		}
 
-		deleteAllAndREntries();
+		printf("Keys in the set AND: \t%zu\n", AndSet.used);
+		printAndEntries(&AndSet);	
+
+		freeCandidateSet(&AndRSet);
 
 		/*-------------------------------------------------------------------------------------------
 		 *		the attacker obtains the correct value of (KO_8,3, KI_8,3, KL_8,1)
 		 *-------------------------------------------------------------------------------------------*/
 
-		struct OrEntry *o;
-		struct AndEntry *a;
+		for (size_t i = 0; i < OrSet -> used; i++) {
+			u64 o = OrSet -> key[i];
 
-		if (HASH_COUNT(AndSet) > 0) {
-			for (o = OrSet; o != NULL; o = o -> hh.next) {
-				if ((KO81 == o -> index[0]) && (KI81 == o-> index[1])) {
-					for (a = AndSet; a != NULL; a = a -> hh.next) {
-						addSubkeysEntry(o -> index[0], o -> index[1], o -> index[2], a -> index[0], a -> index[1], a -> index[2]);
-					}
+			if ((KO81 == CANDIDATE_KO(o)) && (KI81 == CANDIDATE_KI(o))) {
+				for (size_t j = 0; j < AndSet.used; j++) {
+					u64 a = AndSet.key[j];
+					addSubkeysEntry(&(run -> SubkeysSet), KO81, KI81, CANDIDATE_KL(o), CANDIDATE_KO(a), CANDIDATE_KI(a), CANDIDATE_KL(a));
 				}
 			}
 		}
-
-		prevKO81 = KO81;
-		prevKI81 = KI81;
 	}
 
-	deleteAllOrEntries();
-	deleteAllAndEntries();
-	printf("I have found %d possible values for subkeys KO81, KI81, KL82, KO83, KI83, KL82:\n", HASH_COUNT(SubkeysSet));
-	printSubkeysEntries();
-
-	if (HASH_COUNT(SubkeysSet) == 0) {
+	pthread_mutex_destroy(&(kl81.lock));
+	free(kl81.candidate);
+	free(kl81.suggested);
+	free(kl81.chunksLeft);
+	free(quartets);
+	free(run -> swept);
+	run -> swept = NULL;
+	run -> nSwept = run -> sizeSwept = 0;
+
+	freeCandidateSet(&(run -> OrSet));
+	freeCandidateSet(&AndSet);
+	freeCandidateSet(&suggested);
+	printf("I have found %d possible values for subkeys KO81, KI81, KL82, KO83, KI83, KL82:\n", HASH_COUNT(run -> SubkeysSet));
+	printSubkeysEntries(run -> SubkeysSet);
+
+	if (HASH_COUNT(run -> SubkeysSet) == 0) {
 		printf("The found quartets are not right quartets. Cannot proceed with the attack\n");
-		goto exit;
+		return 1;
 	}
 
+	saveCheckpoint(run, STAGE_4, 0, 0, 1);
+	return 0;
+}
+
+// A set is searched K3_GROUP chunks at a time, with a checkpoint after each group: the
+// progress bar still covers the whole set
+static int k3Searched;
+
+static void printK3Progress(double percentage) {
+	printProgress((k3Searched + percentage * K3_GROUP) / K3_CHUNKS);
+}
+
+int searchPhase(void *arg) {
 	/*-------------------------------------------------------------------------------------------
 	 * 4. Finding the Right Key: (TODO)
 	 *-------------------------------------------------------------------------------------------*/
@@ -1880,96 +2281,262 @@ int main(void) {
 	 *	 	a trial encryption.
 	 *-------------------------------------------------------------------------------------------*/
 
-	u8 P[8], C[8], trialC[8];
+	struct attackRun *run = arg;
+	u8 P[8], C[8];
+	u32 done;
+	int cont, chunk;
 
 	for (int i = 0; i < 8; i++) {
 		P[i] = rand() % 255;
 	}
 
 	memcpy(C, &P[0], 8*sizeof(*P));
-	KeySchedule(Ka);
-	Kasumi(C);
+	Kasumi_r(&ksA, C);
 
 	//printHex("Ka", Ka, 16);
 	//printHex("P", P, 8);
 	//printHex("C", C, 8);
 
-	u16 K3 = 0x0000;
-	u16 K5 = 0x0000;
-	u8 *guessedKa;
+	// The 2^32 (K3, K5) guesses of each candidate are shared among the worker threads; the
+	// first one that finds the key stops all the others.
+	struct searchK3K5Job job;
+	int nThreads = getThreads();
+	job.P = BlockFromBytes(P);
+	job.C = BlockFromBytes(C);
+	job.guessedKa = malloc(nThreads * sizeof(*job.guessedKa));
+	job.keys = malloc(nThreads * sizeof(*job.keys));
+	job.seconds = malloc(nThreads * sizeof(*job.seconds));
+
 	u16 KC[8] = {
 		0x0123, 0x4567, 0x89AB, 0xCDEF, 0xFEDC, 0xBA98, 0x7654, 0x3210 
 	};
 
 	struct SubkeysEntry *s;
+	done = (run -> resume.stage == STAGE_4) ? run -> resume.cursor : 0;
+	chunk = (run -> resume.stage == STAGE_4) ? run -> resume.chunk : 0;
 	cont = 1;
 
-	for (s = SubkeysSet; s != NULL; s = s -> hh.next) {		// (KO81, KI81, KL82, KO83, KI83, KL81)
+	for (s = run -> SubkeysSet; s != NULL && cont <= (int)done; s = s -> hh.next) {
+		cont++;
+	}
+
+	for (; s != NULL; s = s -> hh.next) {		// (KO81, KI81, KL82, KO83, KI83, KL81)
 
 		printf("Analyzing keys set n. %d\n", cont);
 		printf("Guessing the keys K3 and K5...\n");
-		z = 0;	// Initializing the progress bar
-
-		for (int k3 = 0; k3 <= 0xffff; k3++) {				// devo usare delle variabili intere e non u16 sennò si azzera prima di finire e va in loop
-			for (int k5 = 0x0000; k5 <= 0xffff; k5++) {
-				guessedKa = (u8 [16]) {
-					rightRotate(s -> index[0], 5) >> 8,		// K1
-					rightRotate(s -> index[0], 5) & 0xff,
-					(s -> index[2] ^ KC[1]) >> 8,			// K2
-					(s -> index[2] ^ KC[1]) & 0xff,		
-					K3 >> 8,								// K3
-					K3 & 0xff,						
-					(s -> index[1] ^ KC[3]) >> 8,			// K4
-					(s -> index[1] ^ KC[3]) & 0xff,		
-					K5 >> 8,								// K5
-					K5 & 0xff,						
-					rightRotate(s -> index[3], 13) >> 8,	// K6
-					rightRotate(s -> index[3], 13) & 0xff,
-					(s -> index[4] ^ KC[6]) >> 8,			// K7
-					(s -> index[4] ^ KC[6]) & 0xff,		
-					rightRotate(s -> index[5], 1) >> 8,		// K8
-					rightRotate(s -> index[5], 1) & 0xff	
-				};
-
-				memcpy(trialC, &P[0], 8*sizeof(*P));
-				KeySchedule(guessedKa);
-				Kasumi(trialC);
 
-				/*
-				if ((K3 == 0xccdd) && (K5 == 0x1122)) {
-					printHex("guessedKa", guessedKa, 16);
-					printHex("P", P, 8);
-					printHex("trialC", trialC, 8);
-				}
-				*/
+		u8 partialKa[16] = {
+			rightRotate(s -> index[0], 5) >> 8,		// K1
+			rightRotate(s -> index[0], 5) & 0xff,
+			(s -> index[2] ^ KC[1]) >> 8,			// K2
+			(s -> index[2] ^ KC[1]) & 0xff,		
+			0x00,									// K3: guessed
+			0x00,						
+			(s -> index[1] ^ KC[3]) >> 8,			// K4
+			(s -> index[1] ^ KC[3]) & 0xff,		
+			0x00,									// K5: guessed
+			0x00,						
+			rightRotate(s -> index[3], 13) >> 8,	// K6
+			rightRotate(s -> index[3], 13) & 0xff,
+			(s -> index[4] ^ KC[6]) >> 8,			// K7
+			(s -> index[4] ^ KC[6]) & 0xff,		
+			rightRotate(s -> index[5], 1) >> 8,		// K8
+			rightRotate(s -> index[5], 1) & 0xff	
+		};
+
+		job.partialKa = partialKa;
+		job.found = 0;
+		for (int i = 0; i < nThreads; i++) {
+			job.keys[i] = 0;
+			job.seconds[i] = 0;
+		}
 
-				if (compareArray(trialC, C, 8)) {
-					printHex("\nFOUND KEY Ka", guessedKa, 16);
-					//break;
-					goto exit;
-				}
+		for (k3Searched = chunk; k3Searched < K3_CHUNKS && !job.found; k3Searched += K3_GROUP) {
+			job.firstChunk = k3Searched;
+			parallelForUntil(K3_GROUP, searchK3K5Chunk, &job, printK3Progress, &job.found);
 
-				if ((u32)((K3<<16)+(K5)) > z * (pow(2,32)/100.0)) {
-					printProgress(z/100.0);
-					z++;
-				} else if ((u32)((K3<<16)+(K5)) == pow(2,32) - 1) {
-					printProgress(1);
-				}
+			if (!job.found && k3Searched + K3_GROUP < K3_CHUNKS)
+				saveCheckpoint(run, STAGE_4, cont - 1, k3Searched + K3_GROUP, 0);
+		}
+		chunk = 0;
+		printf("\n");
 
-				K5++;
-			}
+		for (int i = 0; i < nThreads; i++) {
+			printf("Thread %d: %llu keys in %.2f s (%.0f keys/s)\n", i, job.keys[i], job.seconds[i], 
+				job.seconds[i] > 0 ? job.keys[i] / job.seconds[i] : 0);
+		}
 
-			K3++;
-			K5 = 0x0000;
+		if (job.found) {
+			printHex("FOUND KEY Ka", job.key, 16);
+			run -> found = 1;
+			break;
 		}
 
-		printf("\n");
 		cont++;
+
+		saveCheckpoint(run, STAGE_4, cont - 1, 0, 0);
+	}
+
+	free(job.guessedKa);
+	free(job.keys);
+	free(job.seconds);
+
+	return 0;
+}
+
+/*--------------------------------------- SANDWICH -----------------------------------------*/
+
+static void printUsage(char *name) {
+	printf("Usage: %s [-t threads] [-j hash|sort] [-s seed] [-c file] [-i seconds] [-d file] [-q file]\n", name);
+	printf("  -t threads\tworker threads for the key guessing (default: one per CPU)\n");
+	printf("  -j engine\tjoin of the data collection: hash table (default) or sort-merge\n");
+	printf("  -s seed\tseed of the structures and of the other random choices (default: the time)\n");
+	printf("  -c file\tcheckpoint phases 3 and 4 to file, and resume from it if it exists\n");
+	printf("  -i seconds\tminimum time between two checkpoints (default: %d)\n", checkpointInterval);
+	printf("  -d file\tsave the structures of phase 1 to file, or read them from it if it exists\n");
+	printf("  -q file\tsave the candidate quartets of phase 1 to file, or read them from it if it exists\n");
+}
+
+int main(int argc, char *argv[]) {
+	u64 seed = (u64)time(NULL);
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:j:s:c:i:d:q:h")) != -1) {
+		switch (opt) {
+			case 't':
+				setThreads(atoi(optarg));
+				break;
+			case 'j':
+				if (!strcmp(optarg, "hash")) {
+					joinEngine = JOIN_HASH;
+				} else if (!strcmp(optarg, "sort")) {
+					joinEngine = JOIN_SORT;
+				} else {
+					printUsage(argv[0]);
+					return 1;
+				}
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 0);
+				break;
+			case 'c':
+				checkpointPath = optarg;
+				break;
+			case 'i':
+				checkpointInterval = atoi(optarg);
+				break;
+			case 'd':
+				structuresPath = optarg;
+				break;
+			case 'q':
+				quartetsPath = optarg;
+				break;
+			default:
+				printUsage(argv[0]);
+				return 1;
+		}
+	}
+
+	printf("Worker threads: %d\n", getThreads());
+	printf("Data collection join: %s\n", (joinEngine == JOIN_SORT) ? "sort-merge" : "hash table");
+
+	// A run resumed from a checkpoint goes on with the seed it was started with
+	struct attackRun run = {0};
+
+	if (loadCheckpoint(&run) == 0) {
+		seed = run.resume.seed;
+		printf("Resuming from the checkpoint %s: phase %s, step %u\n", checkpointPath,
+			(run.resume.stage == STAGE_3A) ? "3(a)" : (run.resume.stage == STAGE_3B) ? "3(b)" : "4", run.resume.cursor);
+		if (run.resume.stage == STAGE_4 && run.resume.chunk > 0)
+			printf("The next set resumes at K3 chunk %u of %d\n", run.resume.chunk, K3_CHUNKS);
+	}
+
+	// Data of an earlier run: they come with the seed of that run
+	if (run.resume.stage == 0 && quartetsPath &&
+		openDataset(&(run.candidates), quartetsPath, DATASET_QUARTETS, sizeof(struct rightQuartetsEntry)) == 0) {
+		seed = run.candidates.header -> seed;
+	} else if (run.resume.stage == 0 && structuresPath &&
+		openDataset(&(run.structures), structuresPath, DATASET_STRUCTURES, sizeof(u64[2])) == 0) {
+		seed = run.structures.header -> seed;
+	}
+	checkpointSeed = seed;
+
+	// Every random choice of the run derives from the seed: print it to repeat the run with -s
+	printf("Seed: %llu\n", seed);
+
+	double begin = wallClock();
+	int exp = 24;
+	run.nPlaintext = pow(2, exp);       // should be pow(2, 24)
+	srand((unsigned) seed);    			// Initializes random number generator
+
+	//int realRightQuartets = 0;
+	//int rightQuartets = 0;
+
+	//int nRightQuartets[30];
+	//for (int i = 0; i < 30; i++) {
+	//	nRightQuartets[i] = 0;
+	//}
+
+	//for (int w = 0; w < 1000; w++) {
+
+	// Hardcoded key Ka
+	
+	Ka = (u8 [16]) {
+		0x99, 0x00, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF,
+		0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 
+	};
+	
+	
+	/*
+	for (int i = 0; i < 16; i++) {
+		Ka[i] = rand() % 255;     // 255_10 = ff_16 = 11111111_2
+	}
+	*/
+	
+	generateRelatedKeys(Ka);
+
+	KeySchedule_r(&ksA, Ka);
+	KeySchedule_r(&ksB, Kb);
+	KeySchedule_r(&ksC, Kc);
+	KeySchedule_r(&ksD, Kd);
+#if !USE_BITSLICE
+	if (KeyScheduleFI(&fkA, Ka) || KeyScheduleFI(&fkB, Kb) ||
+		KeyScheduleFI(&fkC, Kc) || KeyScheduleFI(&fkD, Kd)) {
+		fprintf(stderr, "KeyScheduleFI: out of memory\n");
+		return 1;
 	}
+#endif
+
+	printHex("Ka", Ka, 16);
+	printHex("Kb", Kb, 16);
+	printHex("Kc", Kc, 16);
+	printHex("Kd", Kd, 16);
+
+	// A resumed run starts from the phase of its checkpoint; the -q file of an earlier run
+	// replaces the oracle as phase 1
+	Phase phases[] = {
+		{"collect", run.candidates.map ? readQuartetsPhase : collectPhase, 0},
+		{"filter", filterPhase, 1},
+		{"guess KL82", guessKL82Phase, 0},
+		{"guess KL81", guessKL81Phase, 0},
+		{"search", searchPhase, 0},
+	};
+	int nPhases = sizeof(phases) / sizeof(Phase);
+	int first = (run.resume.stage == STAGE_3A) ? 2 : (run.resume.stage == STAGE_3B) ? 3 : (run.resume.stage == STAGE_4) ? 4 : 0;	// index in phases
+
+	run.seed = seed;
+	initBoundedQueue(&(run.quartets), QUARTET_QUEUE);
+
+	runPipeline(phases, nPhases, first, &run);
+
+	freeBoundedQueue(&(run.quartets));
+	deleteAllRightQuartetsEntries(&(run.rightQuartets));
+	deleteAllOrREntries(&(run.votes));
+	freeCandidateSet(&(run.OrSet));
+	deleteAllSubkeysEntries(&(run.SubkeysSet));
+	printPipelineTimes(phases, nPhases);
 
-	exit: ;
-	clock_t end = clock();
-	double time_spent = (double)(end - begin) / CLOCKS_PER_SEC;
+	double time_spent = wallClock() - begin;
 	printf("Execution time (s): %.2f\n", time_spent);
 
 	if (!getrusage(RUSAGE_SELF, &usage)) {